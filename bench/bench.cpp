@@ -0,0 +1,658 @@
+﻿// замеры времени основных алгоритмов всех программ на детерминированных синтетических изображениях
+// разных размеров и при разном числе потоков; результаты - в JSON или CSV
+//
+// использование:
+//   bench [--sizes 1,4,16] [--threads 1,4] [--repeat 3] [--poisson-iters 300]
+//         [--kernels copy_hist,wavelet,segm,poisson,pixel_expr,half,lut,tiled,planar,float_cache] [--format json|csv] [--out report.json]
+// размеры задаются в мегапикселах (допустимы дробные, например 0.25), типичный диапазон 1..100
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "../gil_utils/gil_compat.h"
+using namespace boost::gil;
+
+#include "../copy_hist/copy_hist.h"
+#include "../wavelet/wavelet.h"
+#include "../segm/segmentation.h"
+#include "../poisson/poisson.h"
+#include "../gil_utils/half_float.h"
+#include "../gil_utils/float_image_cache.h"
+#include "../gil_utils/float_views_io.h"
+
+// число уровней вейвлет-преобразования, как в wavelet.cpp; размеры изображений делаются кратными 2^levels
+const int BENCH_TRANSFORM_LEVELS = 3;
+
+struct bench_options
+{
+  std::vector<double> sizes { 1, 4, 16 };
+  std::vector<int> threads;
+  int repeat = 3;
+  int poisson_iters = 300;
+  std::vector<std::string> kernels { "copy_hist", "wavelet", "segm", "poisson", "pixel_expr", "half", "lut", "tiled", "planar", "float_cache" };
+  std::string format = "json";
+  std::string out;
+};
+
+struct bench_result
+{
+  std::string kernel;
+  double megapixels;
+  ptrdiff_t width, height;
+  int threads;
+  int repeat;
+  double min_seconds, median_seconds;
+  // среднеквадратическое отличие результата от того же алгоритма с промежуточными изображениями в fp32
+  // (для вариантов с хранением в половинной точности), иначе отрицательно
+  double rms_vs_fp32;
+};
+
+// детерминированный шум в [0, 1) по координатам точки
+inline float hash_noise(unsigned x, unsigned y, unsigned seed)
+{
+  unsigned h = x * 374761393u + y * 668265263u + seed * 2246822519u;
+  h = (h ^ (h >> 13)) * 1274126177u;
+  return float((h ^ (h >> 16)) & 0xffff) / 65536.0f;
+}
+
+// размер изображения с отношением сторон 4:3 и заданным числом мегапикселов, стороны кратны 2^levels
+inline point2<ptrdiff_t> synthetic_dimensions(double megapixels)
+{
+  const ptrdiff_t q = ptrdiff_t(1) << (BENCH_TRANSFORM_LEVELS + 1);
+  auto w = ptrdiff_t(std::sqrt(megapixels * 1e6 * 4 / 3));
+  w = std::max(q, w / q * q);
+  auto h = std::max(q, w * 3 / 4 / q * q);
+  return { w, h };
+}
+
+// синтетическое цветное изображение: плавные волны разного периода в каждом канале плюс шум
+inline void make_synthetic_image(const rgb32f_view_t & v, unsigned seed)
+{
+  const float pi = 3.14159265f;
+  for (int y = 0; y < v.height(); ++y)
+  {
+    auto it = v.row_begin(y);
+    for (int x = 0; x < v.width(); ++x, ++it)
+    {
+      float fx = float(x) / v.width(), fy = float(y) / v.height();
+      float r = 0.5f + 0.3f * std::sin(2 * pi * (3 * fx + seed * 0.1f)) + 0.1f * hash_noise(x, y, seed);
+      float g = 0.5f + 0.3f * std::cos(2 * pi * (2 * fy + fx)) + 0.1f * hash_noise(x, y, seed + 1);
+      float b = 0.5f + 0.3f * std::sin(2 * pi * (5 * fx * fy + seed * 0.3f)) + 0.1f * hash_noise(x, y, seed + 2);
+      *it = rgb32f_pixel_t(r, g, b);
+    }
+  }
+}
+
+// синтетическая маска: "звезда" с волнистой границей в центре изображения (заведомо не прямоугольник)
+inline void make_synthetic_mask(const gray8_view_t & m)
+{
+  float cx = m.width() / 2.0f, cy = m.height() / 2.0f, radius = std::min(cx, cy) * 0.6f;
+  for (int y = 0; y < m.height(); ++y)
+  {
+    auto it = m.row_begin(y);
+    for (int x = 0; x < m.width(); ++x, ++it)
+    {
+      float dx = x - cx, dy = y - cy;
+      float angle = std::atan2(dy, dx);
+      float r = radius * (0.8f + 0.2f * std::sin(5 * angle));
+      *it = (dx * dx + dy * dy < r * r) ? 1 : 0;
+    }
+  }
+  fill_pixels(subimage_view(m, 0, 0, int(m.width()), 1), gray8_pixel_t(0));
+  fill_pixels(subimage_view(m, 0, int(m.height()) - 1, int(m.width()), 1), gray8_pixel_t(0));
+  fill_pixels(subimage_view(m, 0, 0, 1, int(m.height())), gray8_pixel_t(0));
+  fill_pixels(subimage_view(m, int(m.width()) - 1, 0, 1, int(m.height())), gray8_pixel_t(0));
+}
+
+// синтетический полутоновый снимок для сегментации: светлый объект по маске на темном фоне с шумом
+inline void make_synthetic_gray(const gray8_view_t & pic, const gray8c_view_t & mask)
+{
+  for (int y = 0; y < pic.height(); ++y)
+  {
+    auto it = pic.row_begin(y);
+    auto im = mask.row_begin(y);
+    for (int x = 0; x < pic.width(); ++x, ++it, ++im)
+    {
+      float v = (*im ? 190.0f : 60.0f) + 80 * (hash_noise(x, y, 7) - 0.5f);
+      *it = (unsigned char)(std::min(255.0f, std::max(0.0f, v)));
+    }
+  }
+}
+
+class bench_runner
+{
+public:
+  explicit bench_runner(const bench_options & opt) : opt_(opt) { }
+
+  // замеряет run() opt_.repeat раз при каждом числе потоков; prepare() вызывается перед каждым замером и не учитывается
+  void measure(const std::string & kernel, const point2<ptrdiff_t> & dims,
+    const std::function<void()> & prepare, const std::function<void()> & run)
+  {
+    last_ = results_.size();
+    for (int t : opt_.threads)
+    {
+#ifdef _OPENMP
+      omp_set_num_threads(t);
+#endif
+      std::vector<double> times;
+      for (int i = 0; i < opt_.repeat; ++i)
+      {
+        if (prepare)
+          prepare();
+        auto start = std::chrono::steady_clock::now();
+        run();
+        times.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+      }
+      std::sort(times.begin(), times.end());
+      bench_result r { kernel, dims.x * dims.y * 1e-6, dims.x, dims.y, t, opt_.repeat, times.front(), times[times.size() / 2], -1 };
+      std::cerr << kernel << " " << r.width << "x" << r.height << " threads=" << t
+        << " min=" << r.min_seconds << "s median=" << r.median_seconds << "s" << std::endl;
+      results_.push_back(r);
+    }
+  }
+
+  // погрешность для результатов последнего вызова measure
+  void set_rms_vs_fp32(double rms)
+  {
+    for (size_t i = last_; i < results_.size(); ++i)
+      results_[i].rms_vs_fp32 = rms;
+  }
+
+  const std::vector<bench_result> & results() const { return results_; }
+
+private:
+  const bench_options & opt_;
+  std::vector<bench_result> results_;
+  size_t last_ = 0;
+};
+
+void bench_copy_hist(bench_runner & runner, const point2<ptrdiff_t> & dims)
+{
+  rgb32f_image_t src(dims), target(dims), img(dims);
+  make_synthetic_image(view(src), 1);
+  make_synthetic_image(view(target), 2);
+  runner.measure("copy_hist_in_dir", dims,
+    [&] { copy_pixels(const_view(src), view(img)); },
+    [&]
+    {
+      copy_hist_in_dir(view(img), view(target), { 1, 0, 0 });
+      copy_hist_in_dir(view(img), view(target), { 0, 1, 0 });
+      copy_hist_in_dir(view(img), view(target), { 0, 0, 1 });
+    });
+}
+
+void bench_wavelet(bench_runner & runner, const point2<ptrdiff_t> & dims)
+{
+  auto f = named_wavelet_filters("CDF9");
+  rgb32f_image_t img(dims), transformed(dims), restored(dims);
+  make_synthetic_image(view(img), 3);
+  runner.measure("wavelet_transform", dims, nullptr,
+    [&] { wavelet_transform(BENCH_TRANSFORM_LEVELS, const_view(img), view(transformed), f.low_pass_analysis, f.hi_pass_analysis); });
+  runner.measure("inverse_transform", dims, nullptr,
+    [&] { inverse_transform(BENCH_TRANSFORM_LEVELS, const_view(transformed), view(restored), f.low_pass_synthesis, f.hi_pass_synthesis); });
+}
+
+void bench_segm(bench_runner & runner, const point2<ptrdiff_t> & dims)
+{
+  gray8_image_t mask(dims), pic(dims);
+  make_synthetic_mask(view(mask));
+  make_synthetic_gray(view(pic), const_view(mask));
+  gray32f_image_t prob(dims);
+  find_prior_probability(const_view(pic), view(prob));
+
+  gray32fu_image_t ds(dims), dss(dims);
+  runner.measure("find_ds", dims, nullptr,
+    [&] { find_ds(const_view(pic), const_view(prob), view(ds)); });
+
+  auto Me = function_view(const_view(ds), discretizor(-TETHA_E, 1, 0));
+  auto notMd = function_view(const_view(ds), discretizor(TETHA_D, 0, 1));
+  runner.measure("find_dss", dims, nullptr,
+    [&] { find_dss(const_view(pic), Me, notMd, view(dss)); });
+
+  // то же по пирамиде с уточнением в узкой полосе; сегментация должна совпасть с полной
+  gray32fu_image_t ds_mr(dims), dss_mr(dims);
+  runner.measure("find_ds_multires", dims, nullptr,
+    [&] { find_ds_multires(const_view(pic), const_view(prob), view(ds_mr)); });
+
+  auto Me_mr = function_view(const_view(ds_mr), discretizor(-TETHA_E, 1, 0));
+  auto notMd_mr = function_view(const_view(ds_mr), discretizor(TETHA_D, 0, 1));
+  runner.measure("find_dss_multires", dims, nullptr,
+    [&] { find_dss_multires(const_view(pic), Me_mr, notMd_mr, view(dss_mr)); });
+
+  size_t differ = 0;
+  for (int y = 0; y < dims.y; ++y)
+    for (int x = 0; x < dims.x; ++x)
+      differ += (const_view(dss)(x, y)[0] > 0) != (const_view(dss_mr)(x, y)[0] > 0);
+  std::cerr << "segm multires: " << differ << " pixels of the segmentation differ" << std::endl;
+}
+
+// таблицы lut.h против вычисления функции для каждого пиксела: априорная вероятность и начальные метки GGDT
+void bench_lut(bench_runner & runner, const point2<ptrdiff_t> & dims)
+{
+  gray8_image_t mask(dims), pic(dims);
+  make_synthetic_mask(view(mask));
+  make_synthetic_gray(view(pic), const_view(mask));
+  gray32f_image_t prob(dims);
+  gray32fu_image_t d(dims);
+
+  runner.measure("prior_per_pixel", dims, nullptr,
+    [&] { transform_pixels(const_view(pic), view(prob), prior_probability); });
+  runner.measure("prior_lut", dims, nullptr,
+    [&] { find_prior_probability(const_view(pic), view(prob)); });
+
+  // два прохода, как в find_ggdt после find_prior_probability, против одного по свернутой таблице
+  runner.measure("seed_per_pixel", dims, nullptr,
+    [&]
+    {
+      transform_pixels(const_view(pic), view(prob), prior_probability);
+      transform_pixels(const_view(prob), view(d), [](pixel_float_t v) -> float { return NU * v; });
+    });
+  auto seed = prior_probability_lut().then([](float p) -> float { return NU * p; });
+  runner.measure("seed_lut", dims, nullptr,
+    [&] { apply_lut(const_view(pic), view(d), seed); });
+}
+
+// сегментация и смешивание над изображениями в файлах по тайлам (tiled_image.h) против тех же алгоритмов в памяти;
+// файлы создаются в текущем каталоге и удаляются; результаты должны совпасть до бита
+void bench_tiled(bench_runner & runner, const point2<ptrdiff_t> & dims, int iters)
+{
+  gray8_image_t mask(dims), pic(dims);
+  make_synthetic_mask(view(mask));
+  make_synthetic_gray(view(pic), const_view(mask));
+  gray32fu_image_t ds(dims), dss(dims);
+  find_ds(const_view(pic), view(ds));
+  auto Me = function_view(const_view(ds), discretizor(-TETHA_E, 1, 0));
+  auto notMd = function_view(const_view(ds), discretizor(TETHA_D, 0, 1));
+  find_dss(const_view(pic), Me, notMd, view(dss));
+
+  tiled_gray8_t tpic("bench-pic.tiles", dims, true);
+  tiled_gray32fu_t tds("bench-ds.tiles", dims, true), tdss("bench-dss.tiles", dims, true);
+  copy_pixels(const_view(pic), tpic.view());
+  runner.measure("find_ds_tiled", dims, nullptr,
+    [&] { find_ds_tiled(tpic, tds, "bench-scratch.tiles"); });
+  runner.measure("find_dss_tiled", dims, nullptr,
+    [&] { find_dss_tiled(tpic, tds, tdss, "bench-scratch.tiles"); });
+
+  rgb32f_image_t fore(dims), back(dims), sol(dims), laplacian(dims);
+  make_synthetic_image(view(fore), 4);
+  make_synthetic_image(view(back), 5);
+  get_laplacian(const_view(mask), const_view(fore), view(laplacian));
+  copy_pixels(const_view(back), view(sol));
+  poisson(iters, const_view(mask), view(sol), const_view(laplacian));
+
+  tiled_image<gray8_pixel_t> tmask("bench-mask.tiles", dims, true);
+  tiled_image<rgb32f_pixel_t> tsol("bench-sol.tiles", dims, true), tlaplacian("bench-laplacian.tiles", dims, true);
+  copy_pixels(const_view(mask), tmask.view());
+  copy_pixels(const_view(laplacian), tlaplacian.view());
+  runner.measure("poisson_tiled", dims,
+    [&] { copy_pixels(const_view(back), tsol.view()); },
+    [&] { poisson_tiled(iters, tmask, tsol, tlaplacian); });
+
+  auto differ = [](const auto & a, const auto & b)
+  {
+    size_t n = 0;
+    for (int y = 0; y < a.height(); ++y)
+      for (int x = 0; x < a.width(); ++x)
+        n += std::memcmp(&a(x, y), &b(x, y), sizeof(a(x, y))) != 0;
+    return n;
+  };
+  std::cerr << "tiled: " << differ(const_view(ds), tds.view()) << " pixels of ds, "
+    << differ(const_view(dss), tdss.view()) << " of dss, "
+    << differ(const_view(sol), tsol.view()) << " of poisson differ" << std::endl;
+}
+
+// вейвлет-разложение в планарном (planar_arithm.h) и обычном чередующемся представлениях;
+// результаты должны совпасть до бита
+void bench_planar(bench_runner & runner, const point2<ptrdiff_t> & dims)
+{
+  auto f = named_wavelet_filters("CDF9");
+  rgb32f_image_t img(dims), transformed(dims);
+  make_synthetic_image(view(img), 3);
+  wavelet_transform(BENCH_TRANSFORM_LEVELS, const_view(img), view(transformed), f.low_pass_analysis, f.hi_pass_analysis);
+
+  rgb32f_planar_image_t planar(dims, PLANAR_ALIGNMENT), transformed_planar(dims, PLANAR_ALIGNMENT);
+  runner.measure("convert_to_planar", dims, nullptr, [&] { copy_pixels(const_view(img), view(planar)); });
+  runner.measure("wavelet_transform_planar", dims, nullptr,
+    [&] { wavelet_transform_planar(BENCH_TRANSFORM_LEVELS, const_view(planar), view(transformed_planar), f.low_pass_analysis, f.hi_pass_analysis); });
+
+  size_t differ = 0;
+  for (int y = 0; y < dims.y; ++y)
+    for (int x = 0; x < dims.x; ++x)
+      differ += rgb32f_pixel_t(const_view(transformed_planar)(x, y)) != const_view(transformed)(x, y);
+  std::cerr << "planar: " << differ << " pixels of wavelet_transform differ" << std::endl;
+}
+
+// повторная загрузка промежуточного изображения: декодирование PNG, чтение формата float_image_cache.h
+// с копированием и его отображение в память; в каждый замер входит проход по всем пикселам,
+// чтобы отображенные страницы действительно были прочитаны; файлы к этому времени уже в кэше ОС
+void bench_float_cache(bench_runner & runner, const point2<ptrdiff_t> & dims)
+{
+  rgb32f_image_t img(dims), loaded;
+  make_synthetic_image(view(img), 6);
+  png_write_float_view("bench-cache.png", const_view(img));
+  raw_write_float_view("bench-cache.f32", const_view(img));
+
+  double sum = 0;
+  auto touch = [&sum](const rgb32fc_view_t & v)
+  {
+    float s = 0;
+    for (int y = 0; y < v.height(); ++y)
+      for (auto it = v.row_begin(y); it != v.row_end(y); ++it)
+        s += (*it)[0] + (*it)[1] + (*it)[2];
+    sum += s;
+  };
+  // тот же проход по изображению в памяти - нижняя граница для загрузок
+  runner.measure("touch_in_memory", dims, nullptr, [&] { touch(const_view(img)); });
+  runner.measure("load_png", dims, nullptr,
+    [&] { png_read_float_image("bench-cache.png", loaded); touch(const_view(loaded)); });
+  runner.measure("load_raw_copy", dims, nullptr,
+    [&] { raw_read_float_image("bench-cache.f32", loaded); touch(const_view(loaded)); });
+  runner.measure("load_raw_mapped", dims, nullptr,
+    [&] { mapped_float_image<> mapped("bench-cache.f32"); touch(mapped.view()); });
+
+  size_t differ = 0;
+  {
+    mapped_float_image<> mapped("bench-cache.f32");
+    for (int y = 0; y < dims.y; ++y)
+      for (int x = 0; x < dims.x; ++x)
+        differ += mapped.view()(x, y) != const_view(img)(x, y);
+  }
+  std::remove("bench-cache.png");
+  std::remove("bench-cache.f32");
+  std::cerr << "float_cache: " << differ << " pixels of the mapped image differ (checksum " << sum << ")" << std::endl;
+}
+
+void bench_poisson(bench_runner & runner, const point2<ptrdiff_t> & dims, int iters)
+{
+  rgb32f_image_t fore(dims), back(dims), sol(dims), laplacian(dims);
+  make_synthetic_image(view(fore), 4);
+  make_synthetic_image(view(back), 5);
+  gray8_image_t mask(dims);
+  make_synthetic_mask(view(mask));
+  get_laplacian(const_view(mask), const_view(fore), view(laplacian));
+  runner.measure("poisson", dims,
+    [&] { copy_pixels(const_view(back), view(sol)); },
+    [&] { poisson(iters, const_view(mask), view(sol), const_view(laplacian)); });
+}
+
+// итерация Гаусса-Зейделя как в poisson1, но на шаблонах выражений pixel_expr.h
+template <typename M, typename S, typename R>
+void poisson1_expr(const M & mask, const S & sol, const R & rhs)
+{
+  auto sol_cross = cross(sol.xy_at(0, 0));
+  for (int y = 1; y + 1 < sol.height(); ++y)
+  {
+    auto sol_loc = sol.xy_at(1, y);
+    auto imask = std::next(mask.row_begin(y));
+    auto irhs = std::next(rhs.row_begin(y));
+    for (int x = 1; x + 1 < sol.width(); ++x, ++imask, ++irhs, ++sol_loc.x())
+    {
+      if (!*imask)
+        continue;
+      assign(*sol_loc, 0.25f * (
+        expr(sol_loc[sol_cross.w]) + sol_loc[sol_cross.n] + sol_loc[sol_cross.s] + sol_loc[sol_cross.e] - *irhs));
+    }
+  }
+}
+
+// свертка как в convolve_downsample_x, но на шаблонах выражений
+template <typename VI, typename VO>
+void convolve_downsample_x_expr(const VI & in, const VO & out, const std::vector<float> & filter, float shift)
+{
+  auto step_back = (filter.size() - 1) / 2;
+  #pragma omp parallel for
+  for (int y = 0; y < out.height(); ++y)
+  {
+    auto i = in.row_begin(y);
+    auto i_end = in.row_end(y);
+    auto is = create_cycle_iterator(i, i_end, step_back > 0 ? i_end - step_back : i);
+    auto o = out.row_begin(y);
+    for (; i < i_end; ++++i, ++++is, ++o)
+    {
+      rgb32f_pixel_t sum(shift, shift, shift);
+      auto ii = is;
+      for (auto f : filter)
+        sum += f * expr(*ii++);
+      *o = sum;
+    }
+  }
+}
+
+// свертка как в convolve_upsample_x, но на обычных операторах color_arithm.h (выход только rgb32f)
+template <typename VI, typename VO>
+void convolve_upsample_x_plain(const VI & in, const VO & out, const std::vector<float> & filter, float shift)
+{
+  auto step_back = (filter.size() - 1) / 2;
+  #pragma omp parallel for
+  for (int y = 0; y < in.height(); ++y)
+  {
+    auto o = out.row_begin(y);
+    auto o_end = out.row_end(y);
+    auto os = create_cycle_iterator(o, o_end, step_back > 0 ? o_end - step_back : o);
+    auto i = in.row_begin(y);
+    for (; o < o_end; ++i, ++++o, ++++os)
+    {
+      auto inval = *i - rgb32f_pixel_t(shift, shift, shift);
+      auto oo = os;
+      for (auto f : filter)
+        *oo++ += f * inval;
+    }
+  }
+}
+
+// обычные операторы color_arithm.h против шаблонов выражений (pixel_expr.h) на тех же циклах:
+// на GCC с -O2 разницы нет, поэтому в poisson1 и convolve_downsample_x оставлены обычные операторы;
+// группа нужна, чтобы повторить замер на других компиляторах (MSVC)
+void bench_pixel_expr(bench_runner & runner, const point2<ptrdiff_t> & dims, int iters)
+{
+  rgb32f_image_t back(dims), sol(dims), rhs(dims);
+  make_synthetic_image(view(back), 6);
+  make_synthetic_image(view(rhs), 7);
+  gray8_image_t mask(dims);
+  make_synthetic_mask(view(mask));
+  auto reset = [&] { copy_pixels(const_view(back), view(sol)); };
+  runner.measure("stencil_plain", dims, reset,
+    [&] { poisson(iters, const_view(mask), view(sol), const_view(rhs)); });
+  runner.measure("stencil_expr", dims, reset,
+    [&]
+    {
+      for (int i = 0; i < iters; ++i)
+        poisson1_expr(const_view(mask), view(sol), const_view(rhs));
+    });
+
+  auto f = named_wavelet_filters("CDF9");
+  rgb32f_image_t half(dims.x / 2, dims.y), full(dims);
+  auto clear = [&] { fill_pixels(view(full), rgb32f_pixel_t(0, 0, 0)); };
+  runner.measure("convolve_down_plain", dims, nullptr,
+    [&] { convolve_downsample_x(const_view(back), view(half), f.low_pass_analysis, 0); });
+  runner.measure("convolve_down_expr", dims, nullptr,
+    [&] { convolve_downsample_x_expr(const_view(back), view(half), f.low_pass_analysis, 0); });
+  runner.measure("convolve_up_plain", dims, clear,
+    [&] { convolve_upsample_x_plain(const_view(half), view(full), f.low_pass_synthesis, 0); });
+  runner.measure("convolve_up_expr", dims, clear,
+    [&] { convolve_upsample_x(const_view(half), view(full), f.low_pass_synthesis, 0); });
+}
+
+// промежуточные изображения в половинной точности (half_float.h) против fp32: время и погрешность
+void bench_half(bench_runner & runner, const point2<ptrdiff_t> & dims, int iters)
+{
+  auto f = named_wavelet_filters("CDF9");
+  rgb32f_image_t img(dims), transformed(dims), restored(dims), transformed16(dims), restored16(dims);
+  make_synthetic_image(view(img), 3);
+  wavelet_transform(BENCH_TRANSFORM_LEVELS, const_view(img), view(transformed), f.low_pass_analysis, f.hi_pass_analysis);
+  inverse_transform(BENCH_TRANSFORM_LEVELS, const_view(transformed), view(restored), f.low_pass_synthesis, f.hi_pass_synthesis);
+
+  runner.measure("wavelet_transform_half", dims, nullptr,
+    [&] { wavelet_transform<rgb16f_image_t>(BENCH_TRANSFORM_LEVELS, const_view(img), view(transformed16), f.low_pass_analysis, f.hi_pass_analysis); });
+  runner.set_rms_vs_fp32(root_mean_square_diff(const_view(transformed), const_view(transformed16)));
+  runner.measure("inverse_transform_half", dims, nullptr,
+    [&] { inverse_transform<rgb16f_image_t>(BENCH_TRANSFORM_LEVELS, const_view(transformed), view(restored16), f.low_pass_synthesis, f.hi_pass_synthesis); });
+  runner.set_rms_vs_fp32(root_mean_square_diff(const_view(restored), const_view(restored16)));
+
+  // правая часть уравнения Пуассона хранится в rgb16f, решение - в fp32
+  rgb32f_image_t fore(dims), back(dims), sol(dims), sol16(dims), laplacian(dims);
+  rgb16f_image_t laplacian16(dims);
+  make_synthetic_image(view(fore), 4);
+  make_synthetic_image(view(back), 5);
+  gray8_image_t mask(dims);
+  make_synthetic_mask(view(mask));
+  get_laplacian(const_view(mask), const_view(fore), view(laplacian));
+  get_laplacian(const_view(mask), const_view(fore), view(laplacian16));
+  copy_pixels(const_view(back), view(sol));
+  poisson(iters, const_view(mask), view(sol), const_view(laplacian));
+  runner.measure("poisson_half_rhs", dims,
+    [&] { copy_pixels(const_view(back), view(sol16)); },
+    [&] { poisson(iters, const_view(mask), view(sol16), const_view(laplacian16)); });
+  runner.set_rms_vs_fp32(root_mean_square_diff(const_view(sol), const_view(sol16)));
+
+  // преобразование целого изображения туда и обратно
+  rgb16f_image_t img16(dims);
+  runner.measure("convert_to_half", dims, nullptr, [&] { convert_pixels(const_view(img), view(img16)); });
+  runner.measure("convert_from_half", dims, nullptr, [&] { convert_pixels(const_view(img16), view(restored16)); });
+  runner.set_rms_vs_fp32(root_mean_square_diff(const_view(img), const_view(restored16)));
+}
+
+template <typename T, typename F>
+std::vector<T> parse_list(const std::string & s, F convert)
+{
+  std::vector<T> res;
+  std::stringstream ss(s);
+  std::string item;
+  while (std::getline(ss, item, ','))
+    if (!item.empty())
+      res.push_back(convert(item));
+  return res;
+}
+
+bench_options parse_options(int argc, char * argv[])
+{
+  bench_options opt;
+#ifdef _OPENMP
+  opt.threads = { 1 };
+  if (omp_get_max_threads() > 1)
+    opt.threads.push_back(omp_get_max_threads());
+#else
+  opt.threads = { 1 };
+#endif
+  for (int i = 1; i < argc; ++i)
+  {
+    std::string arg = argv[i];
+    if (i + 1 >= argc)
+      throw std::runtime_error("missing value for " + arg);
+    std::string value = argv[++i];
+    if (arg == "--sizes")
+      opt.sizes = parse_list<double>(value, [](const std::string & s) { return std::stod(s); });
+    else if (arg == "--threads")
+      opt.threads = parse_list<int>(value, [](const std::string & s) { return std::stoi(s); });
+    else if (arg == "--repeat")
+      opt.repeat = std::stoi(value);
+    else if (arg == "--poisson-iters")
+      opt.poisson_iters = std::stoi(value);
+    else if (arg == "--kernels")
+      opt.kernels = parse_list<std::string>(value, [](const std::string & s) { return s; });
+    else if (arg == "--format")
+      opt.format = value;
+    else if (arg == "--out")
+      opt.out = value;
+    else
+      throw std::runtime_error("unknown option " + arg);
+  }
+  if (opt.sizes.empty() || opt.threads.empty() || opt.repeat < 1)
+    throw std::runtime_error("sizes, threads and repeat shall be positive");
+  if (opt.format != "json" && opt.format != "csv")
+    throw std::runtime_error("format shall be json or csv");
+  return opt;
+}
+
+void write_report(std::ostream & out, const bench_options & opt, const std::vector<bench_result> & results)
+{
+  if (opt.format == "csv")
+  {
+    out << "kernel,megapixels,width,height,threads,repeat,min_seconds,median_seconds,megapixels_per_second,rms_vs_fp32\n";
+    for (const auto & r : results)
+    {
+      out << r.kernel << "," << r.megapixels << "," << r.width << "," << r.height << "," << r.threads << ","
+        << r.repeat << "," << r.min_seconds << "," << r.median_seconds << "," << r.megapixels / r.min_seconds << ",";
+      if (r.rms_vs_fp32 >= 0)
+        out << r.rms_vs_fp32;
+      out << "\n";
+    }
+    return;
+  }
+
+  out << "{\n  \"poisson_iters\": " << opt.poisson_iters << ",\n  \"results\": [";
+  for (size_t i = 0; i < results.size(); ++i)
+  {
+    const auto & r = results[i];
+    out << (i ? "," : "") << "\n    { \"kernel\": \"" << r.kernel << "\", \"megapixels\": " << r.megapixels
+      << ", \"width\": " << r.width << ", \"height\": " << r.height << ", \"threads\": " << r.threads
+      << ", \"repeat\": " << r.repeat << ", \"min_seconds\": " << r.min_seconds
+      << ", \"median_seconds\": " << r.median_seconds << ", \"megapixels_per_second\": " << r.megapixels / r.min_seconds;
+    if (r.rms_vs_fp32 >= 0)
+      out << ", \"rms_vs_fp32\": " << r.rms_vs_fp32;
+    out << " }";
+  }
+  out << "\n  ]\n}\n";
+}
+
+int main(int argc, char * argv[])
+{
+  try
+  {
+    auto opt = parse_options(argc, argv);
+    profile_start();
+    auto enabled = [&](const char * name) { return std::find(opt.kernels.begin(), opt.kernels.end(), name) != opt.kernels.end(); };
+
+    bench_runner runner(opt);
+    for (double mp : opt.sizes)
+    {
+      auto dims = synthetic_dimensions(mp);
+      if (enabled("copy_hist"))
+        bench_copy_hist(runner, dims);
+      if (enabled("wavelet"))
+        bench_wavelet(runner, dims);
+      if (enabled("segm"))
+        bench_segm(runner, dims);
+      if (enabled("poisson"))
+        bench_poisson(runner, dims, opt.poisson_iters);
+      if (enabled("pixel_expr"))
+        bench_pixel_expr(runner, dims, opt.poisson_iters);
+      if (enabled("half"))
+        bench_half(runner, dims, opt.poisson_iters);
+      if (enabled("lut"))
+        bench_lut(runner, dims);
+      if (enabled("tiled"))
+        bench_tiled(runner, dims, opt.poisson_iters);
+      if (enabled("planar"))
+        bench_planar(runner, dims);
+      if (enabled("float_cache"))
+        bench_float_cache(runner, dims);
+    }
+
+    if (opt.out.empty())
+      write_report(std::cout, opt, runner.results());
+    else
+    {
+      std::ofstream out(opt.out);
+      write_report(out, opt, runner.results());
+    }
+  }
+  catch (const std::exception & e)
+  {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,131 @@
+﻿#pragma once
+
+// перенос цветовых гистограмм между изображениями вдоль заданных цветовых направлений
+
+#include <vector>
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <stdexcept>
+
+#include "../gil_utils/profile.h"
+
+using pix_values = std::vector<float>;
+using pix_indices = std::vector<int>;
+
+inline pix_indices get_asc_order_indices(const pix_values & i_img)
+{
+  PROFILE_SCOPE("copy_hist/argsort");
+  pix_indices res(i_img.size());
+  for (size_t i = 0; i < i_img.size(); ++i)
+    res[i] = i;
+  std::sort(res.begin(), res.end(), [&i_img](int a, int b) { return i_img[a] < i_img[b]; });
+  return res;
+}
+
+// значения эталона по возрастанию - профиль эталонного изображения в одном направлении;
+// он не зависит от изменяемого изображения, поэтому вычисляется один раз для многих изображений
+inline pix_values get_sorted_values(pix_values vals)
+{
+  std::sort(vals.begin(), vals.end());
+  return vals;
+}
+
+inline void copy_1d_hist_sorted(pix_values & io_img, const pix_values & i_sorted_target)
+{
+  if (io_img.size() != i_sorted_target.size())
+    throw std::runtime_error("images of differen sizes are not supported");
+  auto ind0 = get_asc_order_indices(io_img);
+
+  const float INERTIA = 0.75f;
+  for (size_t i = 0; i < io_img.size(); ++i)
+  { 
+    auto & v = io_img[ind0[i]];
+    v = INERTIA * v + (1 - INERTIA) * i_sorted_target[i];
+  }
+}
+
+inline void copy_1d_hist(pix_values & io_img, const pix_values & i_target)
+{
+  copy_1d_hist_sorted(io_img, get_sorted_values(i_target));
+}
+
+struct color_dir
+{
+  float r;
+  float g;
+  float b;
+
+  color_dir(float ir, float ig, float ib)
+  {
+    auto rlen = 1 / sqrt(ir*ir + ig*ig + ib*ib);
+    r = ir * rlen;
+    g = ig * rlen;
+    b = ib * rlen;
+  }
+
+  template <typename P>
+  float get_proj(const P & p) const
+  {
+    return r * get_color(p, red_t()) + g * get_color(p, green_t()) + b * get_color(p, blue_t());
+  }
+
+  template <typename P>
+  P set_proj(const P & p, float val) const
+  {
+    P res = p;
+    val -= get_proj(p);
+    get_color(res, red_t()) += r * val;
+    get_color(res, green_t()) += g * val;
+    get_color(res, blue_t()) += b * val;
+    return res;
+  }
+};
+
+template <typename V>
+pix_values get_pix_values_in_color_direction(const V & view, const color_dir & dir)
+{
+  PROFILE_SCOPE("copy_hist/project");
+  pix_values res;
+  res.reserve(view.width() * view.height());
+
+  for (const auto & p : view)
+  {
+    res.push_back(dir.get_proj(p));
+  }
+
+  assert(res.size() == size_t(view.width() * view.height()));
+  return res;
+}
+
+template <typename V>
+void set_pix_values_in_color_direction(const V & view, const pix_values & vals, const color_dir & dir)
+{
+  PROFILE_SCOPE("copy_hist/unproject");
+  if (vals.size() != size_t(view.width() * view.height()))
+    throw std::runtime_error("wrong number of values");
+
+  auto it = vals.begin();
+  for (auto & p : view)
+  {
+    p = dir.set_proj(p, *it++);
+  }
+}
+
+// то же, что copy_hist_in_dir, но эталон задан своим профилем в направлении dir
+template <typename V>
+void copy_hist_in_dir_sorted(const V & img, const pix_values & sorted_target, const color_dir & dir)
+{
+  auto vals = get_pix_values_in_color_direction(img, dir);
+  copy_1d_hist_sorted(vals, sorted_target);
+  set_pix_values_in_color_direction(img, vals, dir);
+}
+
+template <typename V, typename VT>
+void copy_hist_in_dir(const V & img, const VT & target, const color_dir & dir)
+{
+  auto vals = get_pix_values_in_color_direction(img, dir);
+  const auto valsTarget = get_pix_values_in_color_direction(target, dir);
+  copy_1d_hist(vals, valsTarget);
+  set_pix_values_in_color_direction(img, vals, dir);
+}
@@ -12,7 +12,7 @@ inline rgb32f_pixel_t & operator += (rgb32f_pixel_t & a, const rgb32f_pixel_t &
 
 inline rgb32f_pixel_t operator + (rgb32f_pixel_t a, const rgb32f_pixel_t & b)
 {
-  return rgb32f_pixel_t(a) += b;
+  return a += b;
 }
 
 inline rgb32f_pixel_t & operator -= (rgb32f_pixel_t & a, const rgb32f_pixel_t & b)
@@ -25,7 +25,7 @@ inline rgb32f_pixel_t & operator -= (rgb32f_pixel_t & a, const rgb32f_pixel_t &
 
 inline rgb32f_pixel_t operator - (rgb32f_pixel_t a, const rgb32f_pixel_t & b)
 {
-  return rgb32f_pixel_t(a) -= b;
+  return a -= b;
 }
 
 inline rgb32f_pixel_t operator * (float a, rgb32f_pixel_t b)
@@ -43,3 +43,45 @@ inline float operator * (const rgb32f_pixel_t & a, const rgb32f_pixel_t & b)
     get_color(a, green_t()) * get_color(b, green_t()) +
     get_color(a, blue_t()) * get_color(b, blue_t());
 }
+
+// возращает среднеквадратическую разность пикселей между двумя изображениями
+template <typename V1, typename V2>
+double root_mean_square_diff(const V1 & img1, const V2 & img2)
+{
+  if (img1.dimensions() != img2.dimensions())
+    throw std::runtime_error("both images shall have the same dimensions in root_mean_square_diff");
+
+  double res = 0;
+  auto i2 = img2.begin();
+  for (const auto & p1 : img1)
+  {
+    const auto & p2 = *i2++;
+    auto d = p1 - p2;
+    res += d * d;
+  }
+  return sqrt(res / (img1.width() * img1.height()));
+}
+
+// то же только по точкам, выбранным маской (например, по точкам, которые меняет poisson1)
+template <typename M, typename V1, typename V2>
+double root_mean_square_diff(const M & mask, const V1 & img1, const V2 & img2)
+{
+  if (img1.dimensions() != img2.dimensions() || img1.dimensions() != mask.dimensions())
+    throw std::runtime_error("both images shall have the same dimensions in root_mean_square_diff");
+
+  double res = 0;
+  size_t count = 0;
+  auto i1 = img1.begin();
+  auto i2 = img2.begin();
+  for (const auto & m : mask)
+  {
+    const auto & p1 = *i1++;
+    const auto & p2 = *i2++;
+    if (!m)
+      continue;
+    auto d = p1 - p2;
+    res += d * d;
+    ++count;
+  }
+  return count ? sqrt(res / count) : 0;
+}
@@ -0,0 +1,163 @@
+﻿#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+// быстрое преобразование Фурье произвольной длины n:
+// для степеней двойки - итеративный алгоритм Кули-Тьюки,
+// для остальных длин - алгоритм Блюстейна, сводящий задачу к свертке длины степени двойки
+// https://en.wikipedia.org/wiki/Chirp_Z-transform#Bluestein.27s_algorithm
+class fft_plan
+{
+public:
+  using complex_t = std::complex<double>;
+
+  explicit fft_plan(size_t n) : n_(n)
+  {
+    if (n == 0)
+      throw std::runtime_error("fft length shall be positive");
+    if (is_pow2(n))
+    {
+      init_radix2(n);
+      return;
+    }
+
+    size_t m = 1;
+    while (m < 2 * n - 1)
+      m *= 2;
+    conv_.reset(new fft_plan(m));
+
+    const double pi = std::acos(-1.0);
+    chirp_.resize(n);
+    for (size_t k = 0; k < n; ++k)
+    {
+      // k*k берется по модулю 2n, чтобы не терять точность на больших k
+      auto kk = (k * k) % (2 * n);
+      chirp_[k] = std::polar(1.0, -pi * kk / n);
+    }
+
+    chirp_fft_.assign(m, complex_t(0, 0));
+    chirp_fft_[0] = std::conj(chirp_[0]);
+    for (size_t k = 1; k < n; ++k)
+      chirp_fft_[k] = chirp_fft_[m - k] = std::conj(chirp_[k]);
+    conv_->forward(chirp_fft_.data());
+    work_.resize(m);
+  }
+
+  fft_plan(const fft_plan &) = delete;
+  fft_plan & operator =(const fft_plan &) = delete;
+
+  size_t size() const { return n_; }
+
+  // прямое преобразование на месте: X[k] = sum x[j] * exp(-2 pi i j k / n)
+  void forward(complex_t * data)
+  {
+    if (!conv_)
+    {
+      radix2(data);
+      return;
+    }
+
+    auto m = work_.size();
+    for (size_t k = 0; k < n_; ++k)
+      work_[k] = data[k] * chirp_[k];
+    std::fill(work_.begin() + n_, work_.end(), complex_t(0, 0));
+
+    conv_->forward(work_.data());
+    for (size_t k = 0; k < m; ++k)
+      work_[k] = std::conj(work_[k] * chirp_fft_[k]);
+    // обратное преобразование через прямое от комплексно-сопряженного
+    conv_->forward(work_.data());
+
+    const double scale = 1.0 / m;
+    for (size_t k = 0; k < n_; ++k)
+      data[k] = std::conj(work_[k]) * scale * chirp_[k];
+  }
+
+private:
+  static bool is_pow2(size_t n) { return (n & (n - 1)) == 0; }
+
+  void init_radix2(size_t n)
+  {
+    const double pi = std::acos(-1.0);
+    twiddles_.resize(n / 2);
+    for (size_t k = 0; k < n / 2; ++k)
+      twiddles_[k] = std::polar(1.0, -2 * pi * k / n);
+
+    bitrev_.resize(n);
+    size_t bits = 0;
+    while ((size_t(1) << bits) < n)
+      ++bits;
+    for (size_t i = 0; i < n; ++i)
+    {
+      size_t r = 0;
+      for (size_t b = 0; b < bits; ++b)
+        if (i & (size_t(1) << b))
+          r |= size_t(1) << (bits - 1 - b);
+      bitrev_[i] = r;
+    }
+  }
+
+  void radix2(complex_t * data) const
+  {
+    for (size_t i = 0; i < n_; ++i)
+      if (i < bitrev_[i])
+        std::swap(data[i], data[bitrev_[i]]);
+
+    for (size_t len = 2; len <= n_; len *= 2)
+    {
+      auto half = len / 2;
+      auto tstep = n_ / len;
+      for (size_t i = 0; i < n_; i += len)
+        for (size_t j = 0; j < half; ++j)
+        {
+          auto t = twiddles_[j * tstep] * data[i + j + half];
+          data[i + j + half] = data[i + j] - t;
+          data[i + j] += t;
+        }
+    }
+  }
+
+  size_t n_;
+  // для степеней двойки
+  std::vector<complex_t> twiddles_;
+  std::vector<size_t> bitrev_;
+  // для алгоритма Блюстейна
+  std::unique_ptr<fft_plan> conv_;
+  std::vector<complex_t> chirp_, chirp_fft_, work_;
+};
+
+// дискретное синус-преобразование первого типа (DST-I) длины n:
+// X[k] = sum_{j=0..n-1} x[j] * sin(pi (j+1) (k+1) / (n+1));
+// обратное преобразование совпадает с прямым с точностью до множителя 2/(n+1)
+class dst1_plan
+{
+public:
+  explicit dst1_plan(size_t n) : n_(n), fft_(2 * (n + 1)), buf_(2 * (n + 1)) { }
+
+  size_t size() const { return n_; }
+
+  // преобразование на месте через БПФ нечетного продолжения последовательности длины 2(n+1)
+  void operator()(double * data)
+  {
+    auto m = buf_.size();
+    buf_[0] = buf_[n_ + 1] = 0;
+    for (size_t j = 0; j < n_; ++j)
+    {
+      buf_[j + 1] = data[j];
+      buf_[m - 1 - j] = -data[j];
+    }
+    fft_.forward(buf_.data());
+    for (size_t k = 0; k < n_; ++k)
+      data[k] = -0.5 * buf_[k + 1].imag();
+  }
+
+private:
+  size_t n_;
+  fft_plan fft_;
+  std::vector<fft_plan::complex_t> buf_;
+};
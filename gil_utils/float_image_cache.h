@@ -0,0 +1,244 @@
+﻿#pragma once
+
+// собственный формат для промежуточных изображений с пикселами в представлении с плавающей точкой,
+// которые многократно перечитываются: заголовок и затем строки пикселов как они лежат в памяти;
+// строки выровнены на RAW_ROW_ALIGNMENT, данные начинаются с RAW_DATA_OFFSET,
+// поэтому файл можно отобразить в память (mapped_float_image) и работать с ним как с view без копирования
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+const std::size_t RAW_ROW_ALIGNMENT = 64;
+// с такого смещения начинаются данные (кратно размеру страницы)
+const std::size_t RAW_DATA_OFFSET = 4096;
+
+struct raw_float_header
+{
+  char magic[8];          // "MIPTCGF1"
+  std::uint32_t channels; // число каналов float в пикселе
+  std::uint32_t reserved;
+  std::uint64_t width;
+  std::uint64_t height;
+  std::uint64_t row_bytes;
+  std::uint64_t data_offset;
+  std::uint64_t source_size;  // размер и время изменения (st_mtime) файла, из которого получено изображение,
+  std::int64_t source_mtime;  // чтобы проверить, не устарел ли кэш; нули, если изображение получено не из файла
+};
+
+// описание исходного файла для заголовка кэша
+struct raw_float_source
+{
+  std::uint64_t size = 0;
+  std::int64_t mtime = 0;
+};
+
+inline raw_float_header make_raw_float_header(std::size_t channels, std::size_t width, std::size_t height, const raw_float_source & source = {})
+{
+  raw_float_header h;
+  std::memset(&h, 0, sizeof(h));
+  std::memcpy(h.magic, "MIPTCGF1", 8);
+  h.channels = std::uint32_t(channels);
+  h.width = width;
+  h.height = height;
+  auto row = channels * sizeof(float) * width;
+  h.row_bytes = (row + RAW_ROW_ALIGNMENT - 1) / RAW_ROW_ALIGNMENT * RAW_ROW_ALIGNMENT;
+  h.data_offset = RAW_DATA_OFFSET;
+  h.source_size = source.size;
+  h.source_mtime = source.mtime;
+  return h;
+}
+
+inline void check_raw_float_header(const raw_float_header & h, std::size_t channels)
+{
+  if (std::memcmp(h.magic, "MIPTCGF1", 8) != 0)
+    throw std::runtime_error("not a raw float image");
+  if (h.channels != channels)
+    throw std::runtime_error("wrong number of channels in raw float image");
+  if (h.row_bytes < h.channels * sizeof(float) * h.width || h.data_offset < sizeof(h))
+    throw std::runtime_error("corrupted raw float image header");
+}
+
+// записывает изображение с пикселами из float-каналов (rgb32f, gray32f и т.п.) в формате кэша;
+// source - исходный файл, из которого получено изображение
+template <typename View>
+void raw_write_float_view(const char * filename, const View & view, const raw_float_source & source = {})
+{
+  using pixel_t = typename View::value_type;
+  static_assert(sizeof(pixel_t) == num_channels<View>::value * sizeof(float), "only float channels are supported");
+
+  auto h = make_raw_float_header(num_channels<View>::value, view.width(), view.height(), source);
+  std::ofstream out(filename, std::ios::binary);
+  if (!out)
+    throw std::runtime_error(std::string("cannot create ") + filename);
+
+  std::vector<char> buf(std::size_t(h.data_offset), 0);
+  std::memcpy(buf.data(), &h, sizeof(h));
+  out.write(buf.data(), buf.size());
+
+  buf.assign(std::size_t(h.row_bytes), 0);
+  for (int y = 0; y < view.height(); ++y)
+  {
+    std::copy(view.row_begin(y), view.row_end(y), reinterpret_cast<pixel_t *>(buf.data()));
+    out.write(buf.data(), buf.size());
+  }
+  if (!out)
+    throw std::runtime_error(std::string("cannot write ") + filename);
+}
+
+// читает только заголовок файла кэша; false, если файла нет или это не файл кэша
+inline bool raw_read_float_header(const char * filename, raw_float_header & h)
+{
+  std::ifstream in(filename, std::ios::binary);
+  return in.read(reinterpret_cast<char *>(&h), sizeof(h)) && std::memcmp(h.magic, "MIPTCGF1", 8) == 0;
+}
+
+// читает изображение из формата кэша с копированием в img
+template <typename Image>
+void raw_read_float_image(const char * filename, Image & img)
+{
+  using pixel_t = typename Image::value_type;
+  std::ifstream in(filename, std::ios::binary);
+  if (!in)
+    throw std::runtime_error(std::string("cannot open ") + filename);
+
+  raw_float_header h;
+  if (!in.read(reinterpret_cast<char *>(&h), sizeof(h)))
+    throw std::runtime_error(std::string("cannot read ") + filename);
+  check_raw_float_header(h, num_channels<pixel_t>::value);
+
+  img.recreate(typename Image::point_t(h.width, h.height));
+  for (int y = 0; y < img.height(); ++y)
+  {
+    in.seekg(std::streamoff(h.data_offset + y * h.row_bytes));
+    if (!in.read(reinterpret_cast<char *>(&*view(img).row_begin(y)), img.width() * sizeof(pixel_t)))
+      throw std::runtime_error(std::string("cannot read ") + filename);
+  }
+}
+
+// файл кэша, отображенный в память только для чтения;
+// view() указывает прямо на страницы файла, так что загрузка не копирует пикселы,
+// а операционная система подкачивает их по мере обращения
+template <typename Pixel = rgb32f_pixel_t>
+class mapped_float_image
+{
+public:
+  using const_view_t = typename type_from_x_iterator<const Pixel *>::view_t;
+
+  explicit mapped_float_image(const char * filename)
+  {
+#ifdef _WIN32
+    file_ = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file_ == INVALID_HANDLE_VALUE)
+      throw std::runtime_error(std::string("cannot open ") + filename);
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file_, &size))
+    {
+      close();
+      throw std::runtime_error(std::string("cannot get size of ") + filename);
+    }
+    size_ = std::size_t(size.QuadPart);
+    mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    data_ = mapping_ ? MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (!data_)
+    {
+      close();
+      throw std::runtime_error(std::string("cannot map ") + filename);
+    }
+#else
+    fd_ = ::open(filename, O_RDONLY);
+    if (fd_ < 0)
+      throw std::runtime_error(std::string("cannot open ") + filename);
+    struct stat st;
+    if (fstat(fd_, &st) != 0)
+    {
+      close();
+      throw std::runtime_error(std::string("cannot get size of ") + filename);
+    }
+    size_ = std::size_t(st.st_size);
+    data_ = size_ ? mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd_, 0) : MAP_FAILED;
+    if (data_ == MAP_FAILED)
+    {
+      data_ = nullptr;
+      close();
+      throw std::runtime_error(std::string("cannot map ") + filename);
+    }
+#endif
+    if (size_ < sizeof(raw_float_header))
+    {
+      close();
+      throw std::runtime_error(std::string("truncated raw float image ") + filename);
+    }
+    std::memcpy(&header_, data_, sizeof(header_));
+    try
+    {
+      check_raw_float_header(header_, num_channels<Pixel>::value);
+    }
+    catch (...)
+    {
+      close();
+      throw;
+    }
+    if (header_.data_offset + header_.row_bytes * header_.height > size_)
+    {
+      close();
+      throw std::runtime_error(std::string("truncated raw float image ") + filename);
+    }
+  }
+
+  ~mapped_float_image() { close(); }
+
+  mapped_float_image(const mapped_float_image &) = delete;
+  mapped_float_image & operator =(const mapped_float_image &) = delete;
+
+  const_view_t view() const
+  {
+    auto pixels = reinterpret_cast<const Pixel *>(static_cast<const char *>(data_) + header_.data_offset);
+    return interleaved_view(std::size_t(header_.width), std::size_t(header_.height), pixels, std::ptrdiff_t(header_.row_bytes));
+  }
+
+private:
+  void close()
+  {
+#ifdef _WIN32
+    if (data_)
+      UnmapViewOfFile(data_);
+    if (mapping_)
+      CloseHandle(mapping_);
+    if (file_ != INVALID_HANDLE_VALUE)
+      CloseHandle(file_);
+#else
+    if (data_)
+      munmap(data_, size_);
+    if (fd_ >= 0)
+      ::close(fd_);
+#endif
+  }
+
+#ifdef _WIN32
+  HANDLE file_ = INVALID_HANDLE_VALUE;
+  HANDLE mapping_ = nullptr;
+#else
+  int fd_ = -1;
+#endif
+  void * data_ = nullptr;
+  std::size_t size_ = 0;
+  raw_float_header header_;
+};
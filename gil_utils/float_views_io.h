@@ -10,11 +10,10 @@ inline void png_write_float_view(const char* filename, const View& view)
     [](const auto & src, auto & dst) { static_for_each(src, dst, [](auto f, auto & i) { i = (f < 0) ? 0 : (f > 1 ? 255 : int(f*255.5f)); }); }));
 }
 
-// загружает изображение как rgb32f_image_t
+// загружает изображение как rgb32f_image_t;
+// строки декодируются по одной во временный буфер строки и сразу преобразуются в float,
+// так что промежуточное 8-битное изображение целиком не создается
 inline void png_read_float_image(const char* filename, rgb32f_image_t& img)
 {
-  rgb8_image_t img8;
-  png_read_image(filename, img8);
-  img.recreate(img8.dimensions());
-  copy_pixels(color_converted_view<rgb32f_pixel_t>(const_view(img8)), view(img));
+  png_read_and_convert_image(filename, img);
 }
@@ -0,0 +1,19 @@
+﻿#pragma once
+
+// подключение GIL вместе со старым интерфейсом ввода-вывода (png_read_image, jpeg_write_view и т.п.)
+// как для Boost до 1.68 (gil_all.hpp, png_io.hpp), так и для новых версий (gil.hpp, io/*/old.hpp)
+
+#include <boost/version.hpp>
+
+#if BOOST_VERSION < 106800
+#include <boost/gil/gil_all.hpp>
+#pragma warning (push)
+#pragma warning (disable: 4244) // 'argument': conversion from '__int64' to 'png_uint_32', possible loss of data
+#include <boost/gil/extension/io/png_io.hpp>
+#pragma warning (pop)
+#include <boost/gil/extension/io/jpeg_io.hpp>
+#else
+#include <boost/gil.hpp>
+#include <boost/gil/extension/io/png/old.hpp>
+#include <boost/gil/extension/io/jpeg/old.hpp>
+#endif
@@ -0,0 +1,178 @@
+﻿#pragma once
+
+// пикселы с каналами половинной точности (IEEE 754 binary16, 2 байта) для хранения промежуточных изображений:
+// rgb16f_image_t занимает 6 байт на пиксел вместо 12 у rgb32f_image_t;
+// вычисления по-прежнему ведутся в float - канал half_float неявно преобразуется в float при чтении
+// и округляется до ближайшего представимого значения при записи, поэтому алгоритмы, написанные для
+// представлений с float-каналами (свертки, лапласиан, запись в PNG), принимают и представления rgb16f;
+// относительная погрешность хранения - до 2^-11, диапазон - до 65504;
+// выигрыш дают только проходы, ограниченные пропускной способностью памяти: правая часть poisson
+// (на 16 Мп примерно на 15% быстрее fp32) и inverse_transform (примерно на 10%); в wavelet_transform
+// преобразование каналов в свертке обходится дороже сэкономленного чтения (примерно на 30% медленнее fp32),
+// так что там rgb16f оправдан только нехваткой памяти;
+// инструкции F16C используются, только если определен __F16C__ (-mf16c), -mavx2 их не включает;
+// проверки процессора при запуске нет, поэтому в CMake флаг по умолчанию выключен (MIPTCG_F16C)
+
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#ifdef __F16C__
+#define HALF_FLOAT_F16C
+#include <immintrin.h>
+#endif
+
+// преобразования одного значения
+inline float half_to_float(std::uint16_t h)
+{
+#ifdef HALF_FLOAT_F16C
+  return _cvtsh_ss(h);
+#else
+  std::uint32_t sign = std::uint32_t(h & 0x8000) << 16;
+  std::uint32_t exp = (h >> 10) & 0x1f;
+  std::uint32_t mant = h & 0x3ff;
+  std::uint32_t bits;
+  if (exp == 0x1f) // бесконечность или NaN; NaN становится "тихим" с тем же содержимым, как у F16C
+    bits = sign | 0x7f800000 | (mant << 13) | (mant ? 0x400000 : 0);
+  else if (exp != 0) // нормализованное число
+    bits = sign | ((exp + 112) << 23) | (mant << 13);
+  else if (mant == 0) // ноль
+    bits = sign;
+  else // денормализованное число становится нормализованным float
+  {
+    exp = 113;
+    while (!(mant & 0x400))
+    {
+      mant <<= 1;
+      --exp;
+    }
+    bits = sign | (exp << 23) | ((mant & 0x3ff) << 13);
+  }
+  float f;
+  std::memcpy(&f, &bits, sizeof(f));
+  return f;
+#endif
+}
+
+// с округлением к ближайшему (при равенстве - к четному), как _cvtss_sh с _MM_FROUND_TO_NEAREST_INT
+inline std::uint16_t float_to_half(float f)
+{
+#ifdef HALF_FLOAT_F16C
+  return std::uint16_t(_cvtss_sh(f, _MM_FROUND_TO_NEAREST_INT));
+#else
+  std::uint32_t bits;
+  std::memcpy(&bits, &f, sizeof(bits));
+  std::uint16_t sign = std::uint16_t((bits >> 16) & 0x8000);
+  std::uint32_t abs = bits & 0x7fffffff;
+  if (abs >= 0x7f800000) // бесконечность или NaN; у NaN сохраняются старшие биты содержимого, как у F16C
+    return std::uint16_t(sign | 0x7c00 | (abs > 0x7f800000 ? ((abs >> 13) & 0x3ff) | 0x200 : 0));
+  if (abs >= 0x477ff000) // после округления больше 65504
+    return std::uint16_t(sign | 0x7c00);
+  if (abs < 0x38800000) // денормализованное половинной точности
+  {
+    if (abs < 0x33000000) // меньше половины наименьшего денормализованного
+      return sign;
+    std::uint32_t exp = abs >> 23;
+    std::uint32_t mant = (abs & 0x7fffff) | 0x800000;
+    std::uint32_t shift = 126 - exp;
+    std::uint32_t res = mant >> shift;
+    std::uint32_t rest = mant & ((1u << shift) - 1), half = 1u << (shift - 1);
+    if (rest > half || (rest == half && (res & 1)))
+      ++res;
+    return std::uint16_t(sign | res);
+  }
+  std::uint32_t res = ((abs >> 13) - (112 << 10));
+  std::uint32_t rest = abs & 0x1fff;
+  if (rest > 0x1000 || (rest == 0x1000 && (res & 1)))
+    ++res;
+  return std::uint16_t(sign | res);
+#endif
+}
+
+// тип канала GIL
+class half_float
+{
+public:
+  using value_type = half_float;
+  using reference = half_float &;
+  using pointer = half_float *;
+  using const_reference = const half_float &;
+  using const_pointer = const half_float *;
+  static const bool is_mutable = true;
+
+  half_float() = default;
+  // из float и всего, что в него неявно преобразуется (например, канала float32_t пиксела rgb32f)
+  template <typename T, typename = typename std::enable_if<
+    std::is_convertible<T, float>::value && !std::is_same<typename std::decay<T>::type, half_float>::value>::type>
+  half_float(const T & v) : bits_(float_to_half(float(v))) { }
+  operator float() const { return half_to_float(bits_); }
+
+  half_float & operator += (float f) { return *this = float(*this) + f; }
+  half_float & operator -= (float f) { return *this = float(*this) - f; }
+  half_float & operator *= (float f) { return *this = float(*this) * f; }
+
+  static half_float min_value() { return from_bits(0xfbff); } // -65504
+  static half_float max_value() { return from_bits(0x7bff); } // 65504
+
+  static half_float from_bits(std::uint16_t bits)
+  {
+    half_float h;
+    h.bits_ = bits;
+    return h;
+  }
+  std::uint16_t bits() const { return bits_; }
+
+private:
+  std::uint16_t bits_;
+};
+
+static_assert(sizeof(half_float) == 2, "half_float shall occupy 2 bytes");
+
+using rgb16f_pixel_t = pixel<half_float, rgb_layout_t>;
+using rgb16fc_pixel_t = const pixel<half_float, rgb_layout_t>;
+using rgb16f_image_t = image<rgb16f_pixel_t, false>;
+using rgb16f_view_t = rgb16f_image_t::view_t;
+using rgb16fc_view_t = rgb16f_image_t::const_view_t;
+
+// массовое преобразование n значений; с F16C - по 8 значений за инструкцию
+inline void half_to_float(const half_float * in, float * out, size_t n)
+{
+  size_t i = 0;
+#ifdef HALF_FLOAT_F16C
+  for (; i + 8 <= n; i += 8)
+    _mm256_storeu_ps(out + i, _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i))));
+#endif
+  for (; i < n; ++i)
+    out[i] = in[i];
+}
+
+inline void float_to_half(const float * in, half_float * out, size_t n)
+{
+  size_t i = 0;
+#ifdef HALF_FLOAT_F16C
+  for (; i + 8 <= n; i += 8)
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), _mm256_cvtps_ph(_mm256_loadu_ps(in + i), _MM_FROUND_TO_NEAREST_INT));
+#endif
+  for (; i < n; ++i)
+    out[i] = in[i];
+}
+
+// копирование с преобразованием между rgb32f и rgb16f; строки обоих представлений непрерывны,
+// поэтому каждая строка преобразуется как один массив из 3*width значений
+inline void convert_pixels(const rgb16fc_view_t & in, const rgb32f_view_t & out)
+{
+  if (in.dimensions() != out.dimensions())
+    throw std::runtime_error("image dimensions shall be equal");
+  #pragma omp parallel for
+  for (int y = 0; y < in.height(); ++y)
+    half_to_float(reinterpret_cast<const half_float *>(in.row_begin(y)), reinterpret_cast<float *>(out.row_begin(y)), 3 * size_t(in.width()));
+}
+
+inline void convert_pixels(const rgb32fc_view_t & in, const rgb16f_view_t & out)
+{
+  if (in.dimensions() != out.dimensions())
+    throw std::runtime_error("image dimensions shall be equal");
+  #pragma omp parallel for
+  for (int y = 0; y < in.height(); ++y)
+    float_to_half(reinterpret_cast<const float *>(in.row_begin(y)), reinterpret_cast<half_float *>(out.row_begin(y)), 3 * size_t(in.width()));
+}
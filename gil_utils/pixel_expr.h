@@ -0,0 +1,172 @@
+﻿#pragma once
+
+// шаблоны выражений над пикселами: expr(p) превращает пиксел в лист выражения,
+// а +, - и умножение на число над выражениями не вычисляют промежуточных пикселов,
+// а строят дерево, которое вычисляется целиком по каналам в одном цикле при присваивании:
+//   assign(*sol_loc, 0.25f * (expr(w) + n + s + e - rhs));
+//   *o += f * expr(p);                - o может иметь другой тип каналов, например rgb16f (half_float.h)
+// операторы из color_arithm.h над самими пикселами не меняются, так что старый код работает как прежде;
+// быстрее они не считают: GCC с -O2 и так не создает промежуточных пикселов в poisson1 и свертках wavelet.h
+// (группа pixel_expr в bench сравнивает оба варианта, на других компиляторах ее стоит повторить),
+// поэтому там оставлены обычные операторы; выражения сохранены только для смешанных типов каналов,
+// когда результат не rgb32f, например выход в rgb16f в convolve_upsample_x;
+// каналы берутся в порядке хранения, поэтому все пикселы одного выражения должны иметь одинаковую раскладку
+
+#include <type_traits>
+
+template <typename E>
+struct pixel_expression
+{
+  const E & self() const { return static_cast<const E &>(*this); }
+  float operator[](int c) const { return self().channel(c); }
+
+  // вычисленное значение выражения, например для rgb32f_pixel_t d = expr(a) - b;
+  operator rgb32f_pixel_t() const
+  {
+    static_assert(E::size == 3, "expression shall have three channels");
+    return rgb32f_pixel_t(self().channel(0), self().channel(1), self().channel(2));
+  }
+};
+
+// лист выражения: пиксел-lvalue хранится по ссылке, временный пиксел - по значению,
+// так что выражение можно сохранить в auto, пока живы изображения, на которые оно ссылается
+template <typename P>
+class pixel_term : public pixel_expression<pixel_term<P>>
+{
+  using pixel_t = typename std::decay<P>::type;
+  P p_;
+public:
+  static const int size = num_channels<pixel_t>::value;
+  explicit pixel_term(P p) : p_(p) { }
+  float channel(int c) const { return p_[c]; }
+};
+
+template <typename P>
+inline pixel_term<P> expr(P && p)
+{
+  return pixel_term<P>(std::forward<P>(p));
+}
+
+template <typename E>
+inline const E & expr(const pixel_expression<E> & e)
+{
+  return e.self();
+}
+
+// узел выражения: поканальная операция Op над двумя подвыражениями (хранятся по значению - это ссылки и числа)
+template <typename A, typename B, typename Op>
+class pixel_binary : public pixel_expression<pixel_binary<A, B, Op>>
+{
+  A a_;
+  B b_;
+public:
+  static_assert(A::size == B::size, "pixels in expression shall have the same number of channels");
+  static const int size = A::size;
+  pixel_binary(const A & a, const B & b) : a_(a), b_(b) { }
+  float channel(int c) const { return Op::apply(a_.channel(c), b_.channel(c)); }
+};
+
+struct pixel_plus { static float apply(float a, float b) { return a + b; } };
+struct pixel_minus { static float apply(float a, float b) { return a - b; } };
+
+template <typename A>
+class pixel_scaled : public pixel_expression<pixel_scaled<A>>
+{
+  float k_;
+  A a_;
+public:
+  static const int size = A::size;
+  pixel_scaled(float k, const A & a) : k_(k), a_(a) { }
+  float channel(int c) const { return k_ * a_.channel(c); }
+};
+
+// тип листа для второго операнда: выражение остается собой, пиксел заворачивается в pixel_term
+template <typename T, bool IsExpression = std::is_base_of<pixel_expression<typename std::decay<T>::type>, typename std::decay<T>::type>::value>
+struct pixel_operand
+{
+  using type = typename std::decay<T>::type;
+  static const type & get(const type & e) { return e; }
+};
+
+template <typename T>
+struct pixel_operand<T, false>
+{
+  using type = pixel_term<T>;
+  static type get(T && p) { return type(std::forward<T>(p)); }
+};
+
+// разрешает операторы, только если хотя бы один операнд - выражение, а другой - выражение или пиксел GIL
+template <typename A, typename B>
+struct enable_pixel_expression
+  : std::enable_if<
+      (std::is_base_of<pixel_expression<typename std::decay<A>::type>, typename std::decay<A>::type>::value
+        || std::is_base_of<pixel_expression<typename std::decay<B>::type>, typename std::decay<B>::type>::value)
+      && (std::is_base_of<pixel_expression<typename std::decay<A>::type>, typename std::decay<A>::type>::value
+        || is_pixel<typename std::decay<A>::type>::value)
+      && (std::is_base_of<pixel_expression<typename std::decay<B>::type>, typename std::decay<B>::type>::value
+        || is_pixel<typename std::decay<B>::type>::value)>
+{
+};
+
+template <typename A, typename B, typename Op>
+using pixel_binary_t = pixel_binary<typename pixel_operand<A>::type, typename pixel_operand<B>::type, Op>;
+
+template <typename A, typename B, typename = typename enable_pixel_expression<A, B>::type>
+inline pixel_binary_t<A, B, pixel_plus> operator + (A && a, B && b)
+{
+  return { pixel_operand<A>::get(std::forward<A>(a)), pixel_operand<B>::get(std::forward<B>(b)) };
+}
+
+template <typename A, typename B, typename = typename enable_pixel_expression<A, B>::type>
+inline pixel_binary_t<A, B, pixel_minus> operator - (A && a, B && b)
+{
+  return { pixel_operand<A>::get(std::forward<A>(a)), pixel_operand<B>::get(std::forward<B>(b)) };
+}
+
+template <typename E>
+inline pixel_scaled<E> operator * (float k, const pixel_expression<E> & e)
+{
+  return { k, e.self() };
+}
+
+template <typename E>
+inline pixel_scaled<E> operator * (const pixel_expression<E> & e, float k)
+{
+  return { k, e.self() };
+}
+
+// скалярное произведение, как operator * для двух пикселов в color_arithm.h
+template <typename A, typename B>
+inline float operator * (const pixel_expression<A> & a, const pixel_expression<B> & b)
+{
+  static_assert(A::size == B::size, "pixels in expression shall have the same number of channels");
+  float res = 0;
+  for (int c = 0; c < A::size; ++c)
+    res += a[c] * b[c];
+  return res;
+}
+
+// вычисление выражения прямо в пиксел назначения, по одному проходу по каналам;
+// присваивание через = невозможно: шаблонный operator= пиксела GIL принимает только пикселы
+template <typename P, typename E>
+inline void assign(P && dst, const pixel_expression<E> & e)
+{
+  for (int c = 0; c < E::size; ++c)
+    dst[c] = e[c];
+}
+
+template <typename P, typename E, typename = typename std::enable_if<is_pixel<typename std::decay<P>::type>::value>::type>
+inline P && operator += (P && dst, const pixel_expression<E> & e)
+{
+  for (int c = 0; c < E::size; ++c)
+    dst[c] += e[c];
+  return std::forward<P>(dst);
+}
+
+template <typename P, typename E, typename = typename std::enable_if<is_pixel<typename std::decay<P>::type>::value>::type>
+inline P && operator -= (P && dst, const pixel_expression<E> & e)
+{
+  for (int c = 0; c < E::size; ++c)
+    dst[c] -= e[c];
+  return std::forward<P>(dst);
+}
@@ -0,0 +1,180 @@
+﻿#pragma once
+
+// массовые операции над планарными (SoA) изображениями rgb32f_planar_image_t:
+// каждый канал хранится в своей плоскости, поэтому строка канала - просто непрерывный массив float,
+// и внутренние циклы компилятор разворачивает в SIMD-инструкции на полную ширину регистра
+// (в отличие от операций в color_arithm.h над пикселами-структурами из трех float);
+// представления планарных изображений - обычные представления GIL, так что copy_pixels,
+// color_converted_view, subimage_view и т.п. работают с ними без копирования;
+// на планарных изображениях работает вейвлет-разложение wavelet_transform_planar (wavelet.h)
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+// выравнивание строк планарных изображений в байтах (достаточно для AVX-512 и кэш-линии);
+// использование: rgb32f_planar_image_t img(dims, PLANAR_ALIGNMENT);
+const std::size_t PLANAR_ALIGNMENT = 64;
+
+// указатель на начало строки y канала c планарного представления
+inline float * planar_row(const rgb32f_planar_view_t & v, int c, int y)
+{
+  return reinterpret_cast<float *>(dynamic_at_c(v.row_begin(y), c));
+}
+
+inline const float * planar_row(const rgb32fc_planar_view_t & v, int c, int y)
+{
+  return reinterpret_cast<const float *>(dynamic_at_c(v.row_begin(y), c));
+}
+
+// y += a * x
+inline void axpy(float a, const rgb32fc_planar_view_t & x, const rgb32f_planar_view_t & y)
+{
+  if (x.dimensions() != y.dimensions())
+    throw std::runtime_error("image dimensions shall be equal");
+  const int w = int(x.width());
+  #pragma omp parallel for
+  for (int r = 0; r < y.height(); ++r)
+    for (int c = 0; c < 3; ++c)
+    {
+      const float * xi = planar_row(x, c, r);
+      float * yi = planar_row(y, c, r);
+      for (int i = 0; i < w; ++i)
+        yi[i] += a * xi[i];
+    }
+}
+
+// x *= a
+inline void scale(float a, const rgb32f_planar_view_t & x)
+{
+  const int w = int(x.width());
+  #pragma omp parallel for
+  for (int r = 0; r < x.height(); ++r)
+    for (int c = 0; c < 3; ++c)
+    {
+      float * xi = planar_row(x, c, r);
+      for (int i = 0; i < w; ++i)
+        xi[i] *= a;
+    }
+}
+
+// скалярное произведение двух изображений как векторов (сумма по всем каналам всех пикселов)
+inline double dot(const rgb32fc_planar_view_t & x, const rgb32fc_planar_view_t & y)
+{
+  if (x.dimensions() != y.dimensions())
+    throw std::runtime_error("image dimensions shall be equal");
+  const int w = int(x.width());
+  double res = 0;
+  #pragma omp parallel for reduction(+:res)
+  for (int r = 0; r < x.height(); ++r)
+    for (int c = 0; c < 3; ++c)
+    {
+      const float * xi = planar_row(x, c, r);
+      const float * yi = planar_row(y, c, r);
+      // внутри строки - восемь независимых сумм в float, чтобы цикл векторизовался без перестановки сложений;
+      // строки суммируются в double
+      float acc[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+      int i = 0;
+      for (; i + 8 <= w; i += 8)
+        for (int j = 0; j < 8; ++j)
+          acc[j] += xi[i + j] * yi[i + j];
+      float row_sum = 0;
+      for (; i < w; ++i)
+        row_sum += xi[i] * yi[i];
+      for (int j = 0; j < 8; ++j)
+        row_sum += acc[j];
+      res += row_sum;
+    }
+  return res;
+}
+
+// шаблон "крест" для одной строки: out[i] = row[i-1] + below[i] + above[i] + row[i+1] для i в [1, n-1),
+// в том же порядке сложения, что и в poisson1 и get_laplacian
+inline void cross_sum_row(const float * above, const float * row, const float * below, float * out, int n)
+{
+  for (int i = 1; i + 1 < n; ++i)
+    out[i] = row[i - 1] + below[i] + above[i] + row[i + 1];
+}
+
+// лапласиан во всех внутренних точках изображения (крайние строки и столбцы out не меняются)
+inline void laplacian(const rgb32fc_planar_view_t & in, const rgb32f_planar_view_t & out)
+{
+  if (in.dimensions() != out.dimensions())
+    throw std::runtime_error("image dimensions shall be equal");
+  const int w = int(in.width());
+  #pragma omp parallel for
+  for (int r = 1; r < int(in.height()) - 1; ++r)
+    for (int c = 0; c < 3; ++c)
+    {
+      const float * row = planar_row(in, c, r);
+      float * o = planar_row(out, c, r);
+      cross_sum_row(planar_row(in, c, r - 1), row, planar_row(in, c, r + 1), o, w);
+      for (int i = 1; i + 1 < w; ++i)
+        o[i] -= 4 * row[i];
+    }
+}
+
+// свертка строки канала с фильтром и прореживанием в 2 раза, строка замкнута в кольцо:
+// out[j] = shift + sum_k filter[k] * in[(2j - back + k) mod w], back = (filter.size() - 1) / 2;
+// сложения для каждой точки идут в том же порядке, что и в convolve_downsample_x (wavelet.h)
+inline void convolve_downsample_row(const float * in, int w, float * out, const std::vector<float> & filter, float shift)
+{
+  const int n = int(filter.size()), back = (n - 1) / 2, half = w / 2;
+  // точки, окно которых не выходит за края строки: цикл по ним векторизуется
+  const int j0 = std::min(half, (back + 1) / 2);
+  const int j1 = std::max(j0, std::min(half, w - n + back >= 0 ? (w - n + back) / 2 + 1 : 0));
+  for (int j = 0; j < half; ++j)
+    out[j] = shift;
+  for (int k = 0; k < n; ++k)
+  {
+    const float f = filter[k];
+    const float * ik = in + k - back;
+    for (int j = j0; j < j1; ++j)
+      out[j] += f * ik[2 * j];
+  }
+  auto wrapped = [&](int j)
+  {
+    for (int k = 0; k < n; ++k)
+      out[j] += filter[k] * in[((2 * j - back + k) % w + w) % w];
+  };
+  for (int j = 0; j < j0; ++j)
+    wrapped(j);
+  for (int j = j1; j < half; ++j)
+    wrapped(j);
+}
+
+// свертка по строкам планарного изображения с прореживанием по X
+inline void planar_convolve_downsample_x(const rgb32fc_planar_view_t & in, const rgb32f_planar_view_t & out, const std::vector<float> & filter, float shift)
+{
+  if (in.width() / 2 != out.width() || in.height() != out.height())
+    throw std::runtime_error("output image shall be of half width of input image");
+  #pragma omp parallel for
+  for (int r = 0; r < int(out.height()); ++r)
+    for (int c = 0; c < 3; ++c)
+      convolve_downsample_row(planar_row(in, c, r), int(in.width()), planar_row(out, c, r), filter, shift);
+}
+
+// свертка по столбцам планарного изображения с прореживанием по Y: вместо обхода столбцов
+// строки результата накапливаются из строк входа (out_y = shift + sum_k filter[k] * in_(2y - back + k) mod h),
+// так что все обращения к памяти идут подряд; порядок сложений тот же, что и в convolve_downsample_y
+inline void planar_convolve_downsample_y(const rgb32fc_planar_view_t & in, const rgb32f_planar_view_t & out, const std::vector<float> & filter, float shift)
+{
+  if (in.height() / 2 != out.height() || in.width() != out.width())
+    throw std::runtime_error("output image shall be of half height of input image");
+  const int n = int(filter.size()), back = (n - 1) / 2, h = int(in.height()), w = int(in.width());
+  #pragma omp parallel for
+  for (int r = 0; r < int(out.height()); ++r)
+    for (int c = 0; c < 3; ++c)
+    {
+      float * o = planar_row(out, c, r);
+      for (int i = 0; i < w; ++i)
+        o[i] = shift;
+      for (int k = 0; k < n; ++k)
+      {
+        const float f = filter[k];
+        const float * ik = planar_row(in, c, ((2 * r - back + k) % h + h) % h);
+        for (int i = 0; i < w; ++i)
+          o[i] += f * ik[i];
+      }
+    }
+}
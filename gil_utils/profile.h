@@ -0,0 +1,268 @@
+﻿#pragma once
+
+// встроенное профилирование этапов алгоритмов: время, число вызовов и аппаратные счетчики
+// (циклы, инструкции, промахи кэша через perf_event в Linux) накапливаются по именованным этапам;
+//   PROFILE_SCOPE("segm/ggdt_sweep");          - этап от этой строки до конца блока
+//   PROFILE_COUNT("segm/ggdt_changes", n);     - счетчик событий
+// сводка выводится в std::cerr при завершении программы или по запросу (profile_report, profile_report_json);
+// все это собирается, только если определен MIPTCG_PROFILE, иначе макросы пусты,
+// а функции profile_* ничего не делают, так что код с ними не требует #ifdef;
+// счетчики открываются с наследованием, поэтому учитывают и потоки OpenMP, но только созданные
+// после первого обращения к профилировщику - для этого в начале main вызывается profile_start()
+
+#include <ostream>
+#include <string>
+
+#ifdef MIPTCG_PROFILE
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <vector>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+const int PROFILE_COUNTERS = 3;
+const char * const PROFILE_COUNTER_NAMES[PROFILE_COUNTERS] = { "cycles", "instructions", "cache_misses" };
+
+// накопленные данные одного этапа или счетчика событий
+struct profile_stage
+{
+  profile_stage(const std::string & name, bool is_event) : name(name), is_event(is_event)
+  {
+    reset();
+  }
+
+  void reset()
+  {
+    calls = 0;
+    total = 0;
+    for (auto & c : counters)
+      c = 0;
+  }
+
+  const std::string name;
+  const bool is_event;
+  std::atomic<std::uint64_t> calls;
+  std::atomic<std::uint64_t> total; // наносекунды для этапа, сумма для счетчика событий
+  std::atomic<std::uint64_t> counters[PROFILE_COUNTERS];
+};
+
+class profiler
+{
+public:
+  static profiler & instance()
+  {
+    static profiler p;
+    return p;
+  }
+
+  // этапы регистрируются при первом проходе по PROFILE_SCOPE и живут до конца программы
+  profile_stage & stage(const char * name, bool is_event = false)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = index_.find(name);
+    if (it != index_.end())
+      return *it->second;
+    stages_.emplace_back(new profile_stage(name, is_event));
+    index_[name] = stages_.back().get();
+    return *stages_.back();
+  }
+
+  bool has_counters() const { return fds_[0] >= 0; }
+
+  void read_counters(std::uint64_t * values) const
+  {
+    for (int i = 0; i < PROFILE_COUNTERS; ++i)
+    {
+      values[i] = 0;
+#ifdef __linux__
+      if (fds_[i] >= 0 && ::read(fds_[i], &values[i], sizeof(values[i])) != sizeof(values[i]))
+        values[i] = 0;
+#endif
+    }
+  }
+
+  void reset()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto & s : stages_)
+      s->reset();
+  }
+
+  // таблица по этапам в порядке регистрации
+  void report(std::ostream & out)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    out << std::left << std::setw(32) << "stage" << std::right << std::setw(10) << "calls"
+      << std::setw(12) << "total_ms" << std::setw(12) << "mean_us";
+    if (has_counters())
+      out << std::setw(16) << "cycles" << std::setw(16) << "instructions" << std::setw(6) << "ipc" << std::setw(14) << "cache_misses";
+    out << "\n";
+    for (const auto & s : stages_)
+    {
+      std::uint64_t calls = s->calls;
+      out << std::left << std::setw(32) << s->name << std::right << std::setw(10) << calls;
+      if (s->is_event)
+      {
+        out << std::setw(12) << "" << std::setw(12) << "" << "  events=" << s->total << "\n";
+        continue;
+      }
+      double ms = s->total * 1e-6;
+      out << std::fixed << std::setprecision(3) << std::setw(12) << ms
+        << std::setw(12) << (calls ? 1000 * ms / calls : 0.0);
+      if (has_counters())
+      {
+        std::uint64_t cycles = s->counters[0], instructions = s->counters[1];
+        out << std::setw(16) << cycles << std::setw(16) << instructions
+          << std::setprecision(2) << std::setw(6) << (cycles ? double(instructions) / cycles : 0.0)
+          << std::setw(14) << s->counters[2];
+      }
+      out << std::defaultfloat << std::setprecision(6) << "\n";
+    }
+    if (!has_counters())
+      out << "(hardware counters are not available)\n";
+  }
+
+  std::string report_json()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::ostringstream out;
+    out << "{";
+    for (size_t i = 0; i < stages_.size(); ++i)
+    {
+      const auto & s = *stages_[i];
+      out << (i ? ", " : "") << "\"" << s.name << "\": {\"calls\": " << s.calls;
+      if (s.is_event)
+        out << ", \"events\": " << s.total;
+      else
+      {
+        out << ", \"total_ms\": " << s.total * 1e-6;
+        if (has_counters())
+          for (int c = 0; c < PROFILE_COUNTERS; ++c)
+            out << ", \"" << PROFILE_COUNTER_NAMES[c] << "\": " << s.counters[c];
+      }
+      out << "}";
+    }
+    out << "}";
+    return out.str();
+  }
+
+  ~profiler()
+  {
+    if (!stages_.empty())
+      report(std::cerr);
+#ifdef __linux__
+    for (int fd : fds_)
+      if (fd >= 0)
+        ::close(fd);
+#endif
+  }
+
+private:
+  profiler()
+  {
+    for (auto & fd : fds_)
+      fd = -1;
+#ifdef __linux__
+    const std::uint64_t configs[PROFILE_COUNTERS] = { PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES };
+    for (int i = 0; i < PROFILE_COUNTERS; ++i)
+    {
+      perf_event_attr attr = {};
+      attr.size = sizeof(attr);
+      attr.type = PERF_TYPE_HARDWARE;
+      attr.config = configs[i];
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      attr.inherit = 1;
+      fds_[i] = int(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+    }
+    // либо все счетчики, либо ни одного (например, в контейнере или при perf_event_paranoid > 2)
+    for (int fd : fds_)
+      if (fd < 0)
+      {
+        for (auto & f : fds_)
+          if (f >= 0)
+            ::close(f);
+        for (auto & f : fds_)
+          f = -1;
+        break;
+      }
+#endif
+  }
+
+  int fds_[PROFILE_COUNTERS];
+  std::mutex mutex_;
+  std::vector<std::unique_ptr<profile_stage>> stages_;
+  std::map<std::string, profile_stage *> index_;
+};
+
+class profile_scope
+{
+public:
+  explicit profile_scope(profile_stage & stage) : stage_(stage)
+  {
+    profiler::instance().read_counters(counters_);
+    start_ = std::chrono::steady_clock::now();
+  }
+
+  ~profile_scope()
+  {
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_).count();
+    std::uint64_t counters[PROFILE_COUNTERS];
+    profiler::instance().read_counters(counters);
+    stage_.calls += 1;
+    stage_.total += std::uint64_t(ns);
+    for (int i = 0; i < PROFILE_COUNTERS; ++i)
+      stage_.counters[i] += counters[i] - counters_[i];
+  }
+
+  profile_scope(const profile_scope &) = delete;
+  profile_scope & operator =(const profile_scope &) = delete;
+
+private:
+  profile_stage & stage_;
+  std::chrono::steady_clock::time_point start_;
+  std::uint64_t counters_[PROFILE_COUNTERS];
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+
+#define PROFILE_SCOPE(name) \
+  static profile_stage & PROFILE_CONCAT(profile_stage_, __LINE__) = profiler::instance().stage(name); \
+  profile_scope PROFILE_CONCAT(profile_scope_, __LINE__)(PROFILE_CONCAT(profile_stage_, __LINE__))
+
+#define PROFILE_COUNT(name, n) \
+  do \
+  { \
+    static profile_stage & profile_event_ = profiler::instance().stage(name, true); \
+    profile_event_.calls += 1; \
+    profile_event_.total += std::uint64_t(n); \
+  } while (0)
+
+inline void profile_start() { profiler::instance(); }
+inline void profile_report(std::ostream & out) { profiler::instance().report(out); }
+inline std::string profile_report_json() { return profiler::instance().report_json(); }
+inline void profile_reset() { profiler::instance().reset(); }
+
+#else
+
+#define PROFILE_SCOPE(name) ((void)0)
+#define PROFILE_COUNT(name, n) ((void)0)
+
+inline void profile_start() { }
+inline void profile_report(std::ostream &) { }
+inline std::string profile_report_json() { return "{}"; }
+inline void profile_reset() { }
+
+#endif
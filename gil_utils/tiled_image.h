@@ -0,0 +1,392 @@
+﻿#pragma once
+
+// изображение, хранящееся в файле квадратными тайлами и отображенное в память, для обработки изображений,
+// которые вместе с рабочими изображениями того же размера не помещаются в оперативную память;
+// каждый тайл TILE_SIZE x TILE_SIZE пикселов лежит в файле непрерывно и с начала страницы,
+// тайлы одной строки тайлов идут подряд, так что полоса строк изображения - один непрерывный участок файла;
+//   tiled_image<rgb32f_pixel_t> sol("sol.tiles", dims);
+//   copy_pixels(src, sol.view());                  - view() - представление GIL с произвольным доступом
+//   for_each_strip(sol.height(), sol.tile_size(), 1, false, [&](const tile_strip & s) { ... });
+// for_each_strip обходит изображение полосами высотой в строку тайлов с полями сверху и снизу;
+// полоса с полями копируется в непрерывный буфер (strip_buffer), где к ней применяются обычные алгоритмы,
+// и затем строки полосы записываются обратно; следующая полоса заранее запрашивается у системы (prefetch_rows),
+// а обработанная отпускается (release_rows), так что в памяти находятся только буферы и две-три полосы файла;
+// полосы обходятся сверху вниз (или снизу вверх), то есть в порядке строк, поэтому проходы Гаусса-Зейделя
+// и GGDT по полосам дают те же значения, что и по изображению целиком
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#ifdef _WIN32
+// windows.h определяет макросы min, max, near и far: первые два отключаются NOMINMAX,
+// поэтому в заголовках, которые включают этот, нельзя называть переменные near и far
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+const int TILE_SIZE = 256;
+// с такого смещения начинаются тайлы, и на столько же выравнивается каждый тайл
+const std::size_t TILE_PAGE = 4096;
+
+struct tiled_header
+{
+  char magic[8];             // "MIPTCGT1"
+  std::uint32_t pixel_bytes; // размер пиксела
+  std::uint32_t tile_size;   // сторона тайла в пикселах
+  std::uint64_t width;
+  std::uint64_t height;
+  std::uint64_t tile_bytes;  // размер тайла в файле, кратный TILE_PAGE
+  std::uint64_t data_offset;
+};
+
+template <typename Pixel>
+class tiled_image;
+
+// разыменование точки представления GIL в пиксел тайла
+template <typename Pixel>
+class tiled_deref
+{
+public:
+  using point_t = point2<std::ptrdiff_t>;
+  using const_t = tiled_deref;
+  using value_type = Pixel;
+  using reference = Pixel &;
+  using const_reference = const Pixel &;
+  using argument_type = point_t;
+  using result_type = reference;
+  static const bool is_mutable = true;
+
+  explicit tiled_deref(tiled_image<Pixel> * img = nullptr) : img_(img) { }
+  result_type operator()(const point_t & p) const { return img_->at(int(p.x), int(p.y)); }
+
+private:
+  tiled_image<Pixel> * img_;
+};
+
+template <typename Pixel>
+class tiled_image
+{
+public:
+  using view_t = image_view<virtual_2d_locator<tiled_deref<Pixel>, false> >;
+
+  // создает файл (или перезаписывает существующий) для изображения размера dims;
+  // temporary - файл удаляется при закрытии (в Linux - сразу, он остается доступным через отображение)
+  tiled_image(const std::string & filename, const point2<std::ptrdiff_t> & dims, bool temporary = false, int tile = TILE_SIZE)
+  {
+    if (dims.x <= 0 || dims.y <= 0 || tile <= 0)
+      throw std::runtime_error("tiled image dimensions shall be positive");
+    std::memset(&header_, 0, sizeof(header_));
+    std::memcpy(header_.magic, "MIPTCGT1", 8);
+    header_.pixel_bytes = sizeof(Pixel);
+    header_.tile_size = std::uint32_t(tile);
+    header_.width = std::uint64_t(dims.x);
+    header_.height = std::uint64_t(dims.y);
+    header_.tile_bytes = (std::uint64_t(tile) * tile * sizeof(Pixel) + TILE_PAGE - 1) / TILE_PAGE * TILE_PAGE;
+    header_.data_offset = TILE_PAGE;
+    open_file(filename, true, temporary);
+    std::memcpy(data_, &header_, sizeof(header_));
+  }
+
+  // открывает существующий файл для чтения и записи
+  explicit tiled_image(const std::string & filename)
+  {
+    open_file(filename, false, false);
+  }
+
+  ~tiled_image() { close(); }
+
+  tiled_image(const tiled_image &) = delete;
+  tiled_image & operator =(const tiled_image &) = delete;
+
+  point2<std::ptrdiff_t> dimensions() const { return { std::ptrdiff_t(header_.width), std::ptrdiff_t(header_.height) }; }
+  int width() const { return int(header_.width); }
+  int height() const { return int(header_.height); }
+  int tile_size() const { return int(header_.tile_size); }
+
+  Pixel * tile(int tx, int ty) const
+  {
+    auto index = std::uint64_t(ty) * tiles_x() + tx;
+    return reinterpret_cast<Pixel *>(static_cast<char *>(data_) + header_.data_offset + index * header_.tile_bytes);
+  }
+
+  Pixel & at(int x, int y) const
+  {
+    const int t = tile_size();
+    return tile(x / t, y / t)[(y % t) * t + x % t];
+  }
+
+  view_t view()
+  {
+    using locator_t = typename view_t::locator;
+    return view_t(dimensions(), locator_t(typename locator_t::point_t(0, 0), typename locator_t::point_t(1, 1), tiled_deref<Pixel>(this)));
+  }
+
+  // копирует строки [y0, y1) в строки buf начиная с нулевой; ширина buf равна ширине изображения
+  template <typename View>
+  void read_rows(int y0, int y1, const View & buf) const
+  {
+    const int t = tile_size();
+    for (int y = y0; y < y1; ++y)
+    {
+      auto out = buf.row_begin(y - y0);
+      for (int tx = 0; tx * t < width(); ++tx)
+      {
+        const Pixel * in = tile(tx, y / t) + (y % t) * t;
+        out = std::copy(in, in + std::min(t, width() - tx * t), out);
+      }
+    }
+  }
+
+  // записывает строки [y0, y1) из строк buf начиная с row0
+  template <typename View>
+  void write_rows(int y0, int y1, const View & buf, int row0 = 0)
+  {
+    const int t = tile_size();
+    for (int y = y0; y < y1; ++y)
+    {
+      auto in = buf.row_begin(row0 + y - y0);
+      for (int tx = 0; tx * t < width(); ++tx)
+      {
+        const int n = std::min(t, width() - tx * t);
+        std::copy(in, in + n, tile(tx, y / t) + (y % t) * t);
+        in += n;
+      }
+    }
+  }
+
+  // просит систему заранее прочитать строки тайлов, покрывающие строки [y0, y1), не дожидаясь чтения
+  void prefetch_rows(int y0, int y1) const
+  {
+    if (y0 >= y1)
+      return;
+    char * begin;
+    std::size_t size;
+    tile_rows_range(y0, y1, begin, size);
+#ifdef _WIN32
+#if _WIN32_WINNT >= 0x0602
+    WIN32_MEMORY_RANGE_ENTRY range = { begin, size };
+    PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#endif
+#else
+    madvise(begin, size, MADV_WILLNEED);
+#endif
+  }
+
+  // отпускает страницы строк тайлов, покрывающих строки [y0, y1): измененные страницы остаются в файле,
+  // а при следующем обращении читаются заново
+  void release_rows(int y0, int y1) const
+  {
+    if (y0 >= y1)
+      return;
+    char * begin;
+    std::size_t size;
+    tile_rows_range(y0, y1, begin, size);
+#ifdef _WIN32
+    FlushViewOfFile(begin, size);
+    VirtualUnlock(begin, size); // для незаблокированных страниц убирает их из рабочего набора процесса
+#else
+    msync(begin, size, MS_ASYNC);
+    madvise(begin, size, MADV_DONTNEED);
+#endif
+  }
+
+private:
+  std::uint64_t tiles_x() const { return (header_.width + header_.tile_size - 1) / header_.tile_size; }
+  std::uint64_t tiles_y() const { return (header_.height + header_.tile_size - 1) / header_.tile_size; }
+  std::size_t file_size() const { return std::size_t(header_.data_offset + tiles_x() * tiles_y() * header_.tile_bytes); }
+
+  void tile_rows_range(int y0, int y1, char * & begin, std::size_t & size) const
+  {
+    const int t = tile_size();
+    begin = reinterpret_cast<char *>(tile(0, y0 / t));
+    size = std::size_t(((y1 - 1) / t - y0 / t + 1) * tiles_x() * header_.tile_bytes);
+  }
+
+  void open_file(const std::string & filename, bool create, bool temporary)
+  {
+#ifdef _WIN32
+    file_ = CreateFileA(filename.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, create ? CREATE_ALWAYS : OPEN_EXISTING,
+      FILE_ATTRIBUTE_NORMAL | (temporary ? FILE_FLAG_DELETE_ON_CLOSE : 0), nullptr);
+    if (file_ == INVALID_HANDLE_VALUE)
+      throw std::runtime_error("cannot open " + filename);
+    if (create)
+    {
+      size_ = file_size();
+      LARGE_INTEGER size;
+      size.QuadPart = LONGLONG(size_);
+      if (!SetFilePointerEx(file_, size, nullptr, FILE_BEGIN) || !SetEndOfFile(file_))
+      {
+        close();
+        throw std::runtime_error("cannot allocate " + filename);
+      }
+    }
+    else
+    {
+      LARGE_INTEGER size;
+      if (!GetFileSizeEx(file_, &size))
+      {
+        close();
+        throw std::runtime_error("cannot get size of " + filename);
+      }
+      size_ = std::size_t(size.QuadPart);
+    }
+    mapping_ = size_ ? CreateFileMappingA(file_, nullptr, PAGE_READWRITE, 0, 0, nullptr) : nullptr;
+    data_ = mapping_ ? MapViewOfFile(mapping_, FILE_MAP_ALL_ACCESS, 0, 0, 0) : nullptr;
+    if (!data_)
+    {
+      close();
+      throw std::runtime_error("cannot map " + filename);
+    }
+#else
+    fd_ = ::open(filename.c_str(), create ? O_RDWR | O_CREAT | O_TRUNC : O_RDWR, 0644);
+    if (fd_ < 0)
+      throw std::runtime_error("cannot open " + filename);
+    if (temporary)
+      unlink(filename.c_str());
+    if (create)
+    {
+      size_ = file_size();
+      if (ftruncate(fd_, off_t(size_)) != 0)
+      {
+        close();
+        throw std::runtime_error("cannot allocate " + filename);
+      }
+    }
+    else
+    {
+      struct stat st;
+      if (fstat(fd_, &st) != 0)
+      {
+        close();
+        throw std::runtime_error("cannot get size of " + filename);
+      }
+      size_ = std::size_t(st.st_size);
+    }
+    data_ = size_ ? mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0) : MAP_FAILED;
+    if (data_ == MAP_FAILED)
+    {
+      data_ = nullptr;
+      close();
+      throw std::runtime_error("cannot map " + filename);
+    }
+#endif
+    if (!create)
+    {
+      if (size_ < sizeof(header_))
+      {
+        close();
+        throw std::runtime_error("truncated tiled image " + filename);
+      }
+      std::memcpy(&header_, data_, sizeof(header_));
+      if (std::memcmp(header_.magic, "MIPTCGT1", 8) != 0 || header_.pixel_bytes != sizeof(Pixel) || header_.tile_size == 0
+        || header_.tile_bytes < std::uint64_t(header_.tile_size) * header_.tile_size * sizeof(Pixel) || file_size() > size_)
+      {
+        close();
+        throw std::runtime_error("not a tiled image of this pixel type: " + filename);
+      }
+    }
+  }
+
+  void close()
+  {
+#ifdef _WIN32
+    if (data_)
+      UnmapViewOfFile(data_);
+    if (mapping_)
+      CloseHandle(mapping_);
+    if (file_ != INVALID_HANDLE_VALUE)
+      CloseHandle(file_);
+#else
+    if (data_)
+      munmap(data_, size_);
+    if (fd_ >= 0)
+      ::close(fd_);
+#endif
+  }
+
+#ifdef _WIN32
+  HANDLE file_ = INVALID_HANDLE_VALUE;
+  HANDLE mapping_ = nullptr;
+#else
+  int fd_ = -1;
+#endif
+  void * data_ = nullptr;
+  std::size_t size_ = 0;
+  tiled_header header_;
+};
+
+// полоса изображения высотой в строку тайлов: строки [y0, y1), те же строки с полями [top, bottom),
+// обрезанными краями изображения, и строки следующей в порядке обхода полосы с полями [next_top, next_bottom)
+// (пустые у последней полосы)
+struct tile_strip
+{
+  int y0, y1;
+  int top, bottom;
+  int next_top, next_bottom;
+};
+
+// обходит строки [0, height) полосами по tile строк с полями halo строк сверху вниз или, если upward, снизу вверх
+template <typename F>
+void for_each_strip(int height, int tile, int halo, bool upward, F f)
+{
+  const int strips = (height + tile - 1) / tile;
+  auto bounds = [&](int i, int & top, int & bottom)
+  {
+    top = std::max(0, i * tile - halo);
+    bottom = std::min(height, (i + 1) * tile + halo);
+  };
+  for (int k = 0; k < strips; ++k)
+  {
+    const int i = upward ? strips - 1 - k : k;
+    tile_strip s;
+    s.y0 = i * tile;
+    s.y1 = std::min(height, (i + 1) * tile);
+    bounds(i, s.top, s.bottom);
+    s.next_top = s.next_bottom = 0;
+    if (k + 1 < strips)
+      bounds(upward ? i - 1 : i + 1, s.next_top, s.next_bottom);
+    f(s);
+  }
+}
+
+// непрерывный буфер для полосы с полями; изображение в нем переиспользуется от полосы к полосе
+template <typename Image>
+class strip_buffer
+{
+public:
+  using view_t = typename Image::view_t;
+
+  // читает полосу s с полями из img и возвращает представление строк [s.top, s.bottom)
+  template <typename Pixel>
+  view_t load(const tiled_image<Pixel> & img, const tile_strip & s)
+  {
+    point2<std::ptrdiff_t> dims(img.width(), s.bottom - s.top);
+    if (buf_.dimensions() != dims)
+      buf_.recreate(dims);
+    img.read_rows(s.top, s.bottom, boost::gil::view(buf_));
+    return boost::gil::view(buf_);
+  }
+
+  // записывает строки [s.y0, s.y1) обратно в img
+  template <typename Pixel>
+  void store(tiled_image<Pixel> & img, const tile_strip & s) const
+  {
+    img.write_rows(s.y0, s.y1, const_view(buf_), s.y0 - s.top);
+  }
+
+private:
+  Image buf_;
+};
@@ -2,192 +2,17 @@
 //https://www.cs.jhu.edu/~misha/Fall07/Papers/Perez03.pdf
 //чтобы собрать программу, надо слинковать с libpng.lib и zlib.lib
 
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
 #include <boost/gil/gil_all.hpp>
 #include <boost/gil/extension/io/png_io.hpp>
 using namespace boost::gil;
 
-#include "..\gil_utils\color_arithm.h"
-#include "..\gil_utils\float_views_io.h"
-
-// копирование пикселов маски из from в to
-template <typename M, typename V, typename VT>
-void clone(const M & mask, const V & from, const VT & to)
-{
-  if (from.dimensions() != mask.dimensions() || from.dimensions() != to.dimensions())
-    throw std::runtime_error("image dimensions shall be equal");
-  auto ito = to.begin();
-  auto imask = mask.begin();
-  for (const auto & p : from)
-  {
-    if (*imask)
-      *ito = p;
-    ++ito;
-    ++imask;
-  }
-}
-
-inline float absmax(float a, float b)
-{
-  return fabs(a) >= fabs(b) ? a : b;
-}
-
-inline rgb32f_pixel_t absmax(rgb32f_pixel_t a, const rgb32f_pixel_t & b)
-{
-  get_color(a, red_t()) = absmax(get_color(a, red_t()), get_color(b, red_t()));
-  get_color(a, green_t()) = absmax(get_color(a, green_t()), get_color(b, green_t()));
-  get_color(a, blue_t()) = absmax(get_color(a, blue_t()), get_color(b, blue_t()));
-  return a;
-}
-
-// запоминает смещения до четырех соседних пикселов
-template <typename L>
-struct cross_locations
-{
-  cross_locations(const L & loc)
-    : w(loc.cache_location(-1, 0))
-    , n(loc.cache_location(0, 1))
-    , s(loc.cache_location(0, -1))
-    , e(loc.cache_location(1, 0))
-  {
-  }
-  typename L::cached_location_t w, n, s, e;
-};
-
-template <typename L>
-inline cross_locations<L> cross(const L & loc)
-{
-  return { loc };
-}
-
-// одна итерация решения задачи Пуассона методом Гаусса-Зейделя:
-// https://ru.wikipedia.org/wiki/Метод_Гаусса_—_Зейделя_решения_системы_линейных_уравнений
-// mask - только точки, выбранные маской, будут меняться
-// sol - исходное и результирующее приближения решения
-// rhs - правая часть уравнения
-template <typename M, typename S, typename R>
-void poisson1(const M & mask, const S & sol, const R & rhs)
-{
-  if (sol.dimensions() != mask.dimensions() || sol.dimensions() != rhs.dimensions())
-    throw std::runtime_error("image dimensions shall be equal");
-
-  auto sol_cross = cross(sol.xy_at(0, 0));
-
-  for (int y = 1; y + 1 < sol.height(); ++y)
-  {
-    auto sol_loc = sol.xy_at(1, y);
-    auto imask = std::next(mask.row_begin(y));
-    auto irhs = std::next(rhs.row_begin(y));
-    for (int x = 1; x + 1 < sol.width(); ++x, ++imask, ++irhs, ++sol_loc.x())
-    {
-      if (!*imask)
-        continue;
-      *sol_loc = 0.25f * (
-        sol_loc[sol_cross.w] + sol_loc[sol_cross.n] + sol_loc[sol_cross.s] + sol_loc[sol_cross.e] - *irhs);
-    }
-  }
-}
-
-// n итераций методом Гаусса-Зейделя
-template <typename M, typename S, typename R>
-void poisson(int n, const M & mask, const S & sol, const R & rhs)
-{
-  for (int i = 0; i < n; ++i)
-    poisson1(mask, sol, rhs);
-}
-
-// вычисляет лапласиан данного изображения в каждой точке маски
-template <typename M, typename V, typename L>
-void get_laplacian(const M & mask, const V & img, const L & laplacian)
-{
-  if (img.dimensions() != mask.dimensions() || img.dimensions() != laplacian.dimensions())
-    throw std::runtime_error("image dimensions shall be equal");
-
-  auto img_cross = cross(img.xy_at(0, 0));
-
-  for (int y = 1; y + 1 < img.height(); ++y)
-  {
-    auto img_loc = img.xy_at(1, y);
-    auto imask = std::next(mask.row_begin(y));
-    auto il = std::next(laplacian.row_begin(y));
-    for (int x = 1; x + 1 < img.width(); ++x, ++imask, ++il, ++img_loc.x())
-    {
-      if (!*imask)
-        continue;
-      *il = img_loc[img_cross.w] + img_loc[img_cross.n] + img_loc[img_cross.s] + img_loc[img_cross.e] - 4 * *img_loc;
-    }
-  }
-}
-
-// вычисляет "лапласиан", используя максимальные по модулю разности из двух изображений
-template <typename M, typename V1, typename V2, typename L>
-void get_absmax_laplacian(const M & mask, const V1 & img1, const V2 & img2, const L & laplacian)
-{
-  if (img1.dimensions() != mask.dimensions() || img1.dimensions() != laplacian.dimensions() || img2.dimensions() != laplacian.dimensions())
-    throw std::runtime_error("image dimensions shall be equal");
-
-  auto img1_cross = cross(img1.xy_at(0, 0));
-  auto img2_cross = cross(img2.xy_at(0, 0));
-
-  for (int y = 1; y + 1 < img1.height(); ++y)
-  {
-    auto img1_loc = img1.xy_at(1, y);
-    auto img2_loc = img2.xy_at(1, y);
-    auto imask = std::next(mask.row_begin(y));
-    auto il = std::next(laplacian.row_begin(y));
-    for (int x = 1; x + 1 < img1.width(); ++x, ++imask, ++il, ++img1_loc.x(), ++img2_loc.x())
-    {
-      if (!*imask)
-        continue;
-      *il = 
-        absmax(img1_loc[img1_cross.w] - *img1_loc, img2_loc[img2_cross.w] - *img2_loc) +
-        absmax(img1_loc[img1_cross.n] - *img1_loc, img2_loc[img2_cross.n] - *img2_loc) +
-        absmax(img1_loc[img1_cross.s] - *img1_loc, img2_loc[img2_cross.s] - *img2_loc) +
-        absmax(img1_loc[img1_cross.e] - *img1_loc, img2_loc[img2_cross.e] - *img2_loc);
-    }
-  }
-}
-
-// помечаем пикселы маски рядом с правой границей числом 2
-template <typename M>
-void mark_xpos(const M & mask)
-{
-  for (int y = 0; y < mask.height(); ++y)
-  { 
-    auto i = mask.row_begin(y), iEnd = mask.row_end(y);
-    bool prev = false;
-    for (; i != iEnd; ++i)
-    {
-      bool curr = *i != 0;
-      if (!prev && curr)
-        *i = 2;
-      prev = curr;
-    }
-  }
-}
-
-// выедание пикселов маски со всех четырех сторон
-template <typename M>
-void erode(const M & mask)
-{
-  mark_xpos(mask);
-  mark_xpos(rotated180_view(mask));
-  mark_xpos(rotated90cw_view(mask));
-  mark_xpos(rotated90ccw_view(mask));
-  //замена 2 на 0
-  for (auto & p : mask) 
-    if (p == 2) 
-      p = 0;
-}
-
-// функтор, который возвращает (0,0,0) для любой точки
-struct zero
-{
-  using argument_type = point2<ptrdiff_t>;
-  using value_type = rgb32f_pixel_t;
-  using reference  = rgb32f_pixel_t;
-  using const_t = zero;
-  rgb32f_pixel_t operator()(const point2<ptrdiff_t>& p) const { return{ 0, 0, 0 }; }
-};
+#include "../gil_utils/float_views_io.h"
+#include "poisson.h"
 
 void main()
 {
@@ -211,24 +36,79 @@ void main()
   clone(const_view(mask), const_view(foref), view(clonef));
   png_write_float_view("clone.png", const_view(clonef));
 
-  // заполнение дырки в фоне методом Лапласа (объект игнорируется)
-  rgb32f_image_t laplacef = backf;
+  // правые части трех вариантов заполнения дырки в фоне:
+  // методом Лапласа (объект игнорируется)
   using zero_locator = virtual_2d_locator<zero, false>;
   image_view<zero_locator> zero_rhs(backf.dimensions(), zero_locator());
-  poisson(300, const_view(mask), view(laplacef), zero_rhs);
-  png_write_float_view("laplace.png", const_view(laplacef));
-
-  // заполнение дырки в фоне, копируя градиент из объекта
-  rgb32f_image_t importf = backf;
+  // копируя градиент из объекта
   rgb32f_image_t fore_laplacian(foref.dimensions());
   get_laplacian(const_view(mask), const_view(foref), view(fore_laplacian));
-  poisson(300, const_view(mask), view(importf), view(fore_laplacian));
-  png_write_float_view("import.png", const_view(importf));
-
-  // заполнение дырки в фоне, используя максимальный градиент из объекта или фона
-  rgb32f_image_t mixedf = backf;
+  // используя максимальный градиент из объекта или фона
   rgb32f_image_t max_fore_back_laplacian(foref.dimensions());
   get_absmax_laplacian(const_view(mask), const_view(foref), const_view(backf), view(max_fore_back_laplacian));
-  poisson(300, const_view(mask), view(mixedf), view(max_fore_back_laplacian));
+
+  // все три задачи с общими маской и границей решаются вместе
+  poisson_batch batch(const_view(mask), 3);
+  batch.set(0, const_view(backf), zero_rhs);
+  batch.set(1, const_view(backf), const_view(fore_laplacian));
+  batch.set(2, const_view(backf), const_view(max_fore_back_laplacian));
+  batch.solve(300);
+
+  rgb32f_image_t laplacef(backf.dimensions());
+  batch.get(0, view(laplacef));
+  png_write_float_view("laplace.png", const_view(laplacef));
+
+  rgb32f_image_t importf(backf.dimensions());
+  batch.get(1, view(importf));
+  png_write_float_view("import.png", const_view(importf));
+
+  rgb32f_image_t mixedf(backf.dimensions());
+  batch.get(2, view(mixedf));
   png_write_float_view("mixed.png", const_view(mixedf));
+
+  // то же без решения системы - мембрана на координатах среднего значения
+  rgb32f_image_t mvcf = backf;
+  mvc_membrane membrane(const_view(mask));
+  membrane.clone(const_view(foref), const_view(backf), view(mvcf));
+  png_write_float_view("import-mvc.png", const_view(mvcf));
+
+  // мембрана сравнивается с практически точным решением той же задачи: 300 итераций выше еще не сошлись,
+  // а прямой poisson_rect годится только для прямоугольной маски, поэтому решение importf доводится
+  // итерациями Гаусса-Зейделя, пока 1000 итераций не перестанут его менять
+  rgb32f_image_t exactf = importf, prevf;
+  for (int i = 0; i < 30; ++i)
+  {
+    prevf = exactf;
+    poisson(1000, const_view(mask), view(exactf), const_view(fore_laplacian));
+    if (root_mean_square_diff(const_view(mask), const_view(prevf), const_view(exactf)) < 1e-6)
+      break;
+  }
+  // разница считается только по точкам маски: вне ее все результаты совпадают с фоном
+  std::cout << "import (300 iterations) vs converged root_mean_square_diff="
+    << root_mean_square_diff(const_view(mask), const_view(importf), const_view(exactf)) << std::endl;
+  std::cout << "mvc import vs converged root_mean_square_diff="
+    << root_mean_square_diff(const_view(mask), const_view(exactf), const_view(mvcf)) << std::endl;
+
+  // ошибка мембраны по точкам маски (наибольшая по каналам) сосредоточена у дырок маски, которые мембрана
+  // не учитывает, и в тонких невыпуклых частях маски; в остальных точках она мала
+  std::vector<float> errors;
+  float max_error = 0;
+  point2<ptrdiff_t> max_at;
+  for (int y = 0; y < mask.height(); ++y)
+    for (int x = 0; x < mask.width(); ++x)
+    {
+      if (!const_view(mask)(x, y))
+        continue;
+      auto d = const_view(exactf)(x, y) - const_view(mvcf)(x, y);
+      float e = std::max(std::abs(d[0]), std::max(std::abs(d[1]), std::abs(d[2])));
+      errors.push_back(e);
+      if (e > max_error)
+      {
+        max_error = e;
+        max_at = { x, y };
+      }
+    }
+  std::nth_element(errors.begin(), errors.begin() + errors.size() / 2, errors.end());
+  std::cout << "mvc import error median=" << errors[errors.size() / 2]
+    << " max=" << max_error << " at (" << max_at.x << ", " << max_at.y << ")" << std::endl;
 }
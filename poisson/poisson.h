@@ -0,0 +1,682 @@
+﻿#pragma once
+
+// смешивание изображений решением уравнения Пуассона и смежные методы клонирования:
+// https://www.cs.jhu.edu/~misha/Fall07/Papers/Perez03.pdf
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "../gil_utils/color_arithm.h"
+#include "../gil_utils/fft.h"
+#include "../gil_utils/profile.h"
+#include "../gil_utils/tiled_image.h"
+
+// копирование пикселов маски из from в to
+template <typename M, typename V, typename VT>
+void clone(const M & mask, const V & from, const VT & to)
+{
+  if (from.dimensions() != mask.dimensions() || from.dimensions() != to.dimensions())
+    throw std::runtime_error("image dimensions shall be equal");
+  auto ito = to.begin();
+  auto imask = mask.begin();
+  for (const auto & p : from)
+  {
+    if (*imask)
+      *ito = p;
+    ++ito;
+    ++imask;
+  }
+}
+
+inline float absmax(float a, float b)
+{
+  return fabs(a) >= fabs(b) ? a : b;
+}
+
+inline rgb32f_pixel_t absmax(rgb32f_pixel_t a, const rgb32f_pixel_t & b)
+{
+  get_color(a, red_t()) = absmax(get_color(a, red_t()), get_color(b, red_t()));
+  get_color(a, green_t()) = absmax(get_color(a, green_t()), get_color(b, green_t()));
+  get_color(a, blue_t()) = absmax(get_color(a, blue_t()), get_color(b, blue_t()));
+  return a;
+}
+
+// запоминает смещения до четырех соседних пикселов
+template <typename L>
+struct cross_locations
+{
+  cross_locations(const L & loc)
+    : w(loc.cache_location(-1, 0))
+    , n(loc.cache_location(0, 1))
+    , s(loc.cache_location(0, -1))
+    , e(loc.cache_location(1, 0))
+  {
+  }
+  typename L::cached_location_t w, n, s, e;
+};
+
+template <typename L>
+inline cross_locations<L> cross(const L & loc)
+{
+  return { loc };
+}
+
+// одна итерация решения задачи Пуассона методом Гаусса-Зейделя:
+// https://ru.wikipedia.org/wiki/Метод_Гаусса_—_Зейделя_решения_системы_линейных_уравнений
+// mask - только точки, выбранные маской, будут меняться
+// sol - исходное и результирующее приближения решения
+// rhs - правая часть уравнения
+template <typename M, typename S, typename R>
+void poisson1(const M & mask, const S & sol, const R & rhs)
+{
+  PROFILE_SCOPE("poisson/gauss_seidel_sweep");
+  if (sol.dimensions() != mask.dimensions() || sol.dimensions() != rhs.dimensions())
+    throw std::runtime_error("image dimensions shall be equal");
+
+  auto sol_cross = cross(sol.xy_at(0, 0));
+
+  for (int y = 1; y + 1 < sol.height(); ++y)
+  {
+    auto sol_loc = sol.xy_at(1, y);
+    auto imask = std::next(mask.row_begin(y));
+    auto irhs = std::next(rhs.row_begin(y));
+    for (int x = 1; x + 1 < sol.width(); ++x, ++imask, ++irhs, ++sol_loc.x())
+    {
+      if (!*imask)
+        continue;
+      *sol_loc = 0.25f * (
+        sol_loc[sol_cross.w] + sol_loc[sol_cross.n] + sol_loc[sol_cross.s] + sol_loc[sol_cross.e] - *irhs);
+    }
+  }
+}
+
+// n итераций методом Гаусса-Зейделя
+template <typename M, typename S, typename R>
+void poisson(int n, const M & mask, const S & sol, const R & rhs)
+{
+  for (int i = 0; i < n; ++i)
+    poisson1(mask, sol, rhs);
+}
+
+// n итераций методом Гаусса-Зейделя над изображениями в файлах (tiled_image.h), когда они не помещаются в память:
+// каждая итерация обходит изображение полосами сверху вниз, и poisson1 в полосе с одной строкой полей сверху и снизу
+// видит над собой уже обновленную строку, а под собой - еще старую, как и при обходе всего изображения,
+// так что результат совпадает с poisson; в памяти одновременно находятся только буферы полосы
+template <typename MP, typename SP, typename RP>
+void poisson_tiled(int n, const tiled_image<MP> & mask, tiled_image<SP> & sol, const tiled_image<RP> & rhs)
+{
+  if (sol.dimensions() != mask.dimensions() || sol.dimensions() != rhs.dimensions())
+    throw std::runtime_error("image dimensions shall be equal");
+  if (sol.tile_size() != mask.tile_size() || sol.tile_size() != rhs.tile_size())
+    throw std::runtime_error("tile sizes shall be equal");
+
+  strip_buffer<image<MP, false> > mask_buf;
+  strip_buffer<image<SP, false> > sol_buf;
+  strip_buffer<image<RP, false> > rhs_buf;
+  for (int i = 0; i < n; ++i)
+    for_each_strip(sol.height(), sol.tile_size(), 1, false, [&](const tile_strip & s)
+    {
+      mask.prefetch_rows(s.next_top, s.next_bottom);
+      sol.prefetch_rows(s.next_top, s.next_bottom);
+      rhs.prefetch_rows(s.next_top, s.next_bottom);
+      poisson1(mask_buf.load(mask, s), sol_buf.load(sol, s), rhs_buf.load(rhs, s));
+      sol_buf.store(sol, s);
+      mask.release_rows(s.y0, s.y1);
+      sol.release_rows(s.y0, s.y1);
+      rhs.release_rows(s.y0, s.y1);
+    });
+}
+
+// проверяет, что точки маски, которые меняет poisson1 (все, кроме крайних строк и столбцов изображения),
+// в точности заполняют некоторый прямоугольник; возвращает его левый верхний угол и размеры
+template <typename M>
+bool find_mask_rectangle(const M & mask, point2<ptrdiff_t> & top_left, point2<ptrdiff_t> & dims)
+{
+  ptrdiff_t x0 = mask.width(), y0 = mask.height(), x1 = -1, y1 = -1, count = 0;
+  for (int y = 1; y + 1 < mask.height(); ++y)
+  {
+    auto imask = std::next(mask.row_begin(y));
+    for (int x = 1; x + 1 < mask.width(); ++x, ++imask)
+    {
+      if (!*imask)
+        continue;
+      x0 = std::min<ptrdiff_t>(x0, x);
+      y0 = std::min<ptrdiff_t>(y0, y);
+      x1 = std::max<ptrdiff_t>(x1, x);
+      y1 = std::max<ptrdiff_t>(y1, y);
+      ++count;
+    }
+  }
+  if (count == 0 || count != (x1 - x0 + 1) * (y1 - y0 + 1))
+    return false;
+  top_left = { x0, y0 };
+  dims = { x1 - x0 + 1, y1 - y0 + 1 };
+  return true;
+}
+
+// прямое решение задачи Пуассона в прямоугольнике с граничными условиями Дирихле,
+// которые берутся из точек sol вокруг прямоугольника;
+// разностный лапласиан диагонализуется синус-преобразованием по строкам и столбцам, что дает O(n log n)
+// https://en.wikipedia.org/wiki/Discrete_Poisson_equation
+template <typename S, typename R>
+void poisson_rect(const point2<ptrdiff_t> & top_left, const point2<ptrdiff_t> & dims, const S & sol, const R & rhs)
+{
+  PROFILE_SCOPE("poisson/dst_solve");
+  if (sol.dimensions() != rhs.dimensions())
+    throw std::runtime_error("image dimensions shall be equal");
+  if (top_left.x < 1 || top_left.y < 1 || top_left.x + dims.x + 1 > sol.width() || top_left.y + dims.y + 1 > sol.height())
+    throw std::runtime_error("rectangle shall be surrounded by boundary pixels");
+
+  const auto w = size_t(dims.x), h = size_t(dims.y);
+  const double pi = std::acos(-1.0);
+  dst1_plan dst_x(w), dst_y(h);
+  std::vector<double> grid(w * h), column(h);
+
+  // собственные числа разностного лапласиана для каждой пары частот
+  std::vector<double> eigen_x(w), eigen_y(h);
+  for (size_t k = 0; k < w; ++k)
+    eigen_x[k] = 2 * std::cos(pi * (k + 1) / (w + 1)) - 2;
+  for (size_t k = 0; k < h; ++k)
+    eigen_y[k] = 2 * std::cos(pi * (k + 1) / (h + 1)) - 2;
+  // прямое и обратное преобразования вместе дают множитель (w+1)(h+1)/4
+  const double scale = 4.0 / ((w + 1) * (h + 1));
+
+  // синус-преобразование всех строк и всех столбцов
+  auto dst2 = [&]()
+  {
+    for (size_t y = 0; y < h; ++y)
+      dst_x(&grid[y * w]);
+    for (size_t x = 0; x < w; ++x)
+    {
+      for (size_t y = 0; y < h; ++y)
+        column[y] = grid[y * w + x];
+      dst_y(column.data());
+      for (size_t y = 0; y < h; ++y)
+        grid[y * w + x] = column[y];
+    }
+  };
+
+  for (size_t c = 0; c < num_channels<S>::value; ++c)
+  {
+    // правая часть, в которую перенесены известные значения на границе прямоугольника
+    for (size_t y = 0; y < h; ++y)
+      for (size_t x = 0; x < w; ++x)
+      {
+        auto sx = top_left.x + x, sy = top_left.y + y;
+        double b = rhs(sx, sy)[c];
+        if (x == 0)
+          b -= sol(sx - 1, sy)[c];
+        if (x + 1 == w)
+          b -= sol(sx + 1, sy)[c];
+        if (y == 0)
+          b -= sol(sx, sy - 1)[c];
+        if (y + 1 == h)
+          b -= sol(sx, sy + 1)[c];
+        grid[y * w + x] = b;
+      }
+
+    dst2();
+    for (size_t y = 0; y < h; ++y)
+      for (size_t x = 0; x < w; ++x)
+        grid[y * w + x] *= scale / (eigen_x[x] + eigen_y[y]);
+    dst2();
+
+    for (size_t y = 0; y < h; ++y)
+      for (size_t x = 0; x < w; ++x)
+        sol(top_left.x + x, top_left.y + y)[c] = float(grid[y * w + x]);
+  }
+}
+
+// решает задачу Пуассона в точках маски: если маска - прямоугольник, то прямым спектральным методом,
+// иначе n итерациями методом Гаусса-Зейделя
+template <typename M, typename S, typename R>
+void solve_poisson(int n, const M & mask, const S & sol, const R & rhs)
+{
+  if (sol.dimensions() != mask.dimensions() || sol.dimensions() != rhs.dimensions())
+    throw std::runtime_error("image dimensions shall be equal");
+
+  point2<ptrdiff_t> top_left, dims;
+  if (find_mask_rectangle(mask, top_left, dims))
+    poisson_rect(top_left, dims, sol, rhs);
+  else
+    poisson(n, mask, sol, rhs);
+}
+
+// одновременное решение нескольких задач Пуассона с общими маской и границей:
+// решения (и правые части) всех вариантов хранятся вперемешку - пиксели всех вариантов для одной точки подряд,
+// поэтому чтение маски, адресация соседей и накладные расходы цикла делятся между вариантами,
+// а внутренний цикл по каналам всех вариантов векторизуется компилятором
+class poisson_batch
+{
+public:
+  static const int channels = num_channels<rgb32f_pixel_t>::value;
+  using variant_view_t = dynamic_xy_step_type<rgb32f_view_t>::type;
+
+  template <typename M>
+  poisson_batch(const M & mask, size_t count)
+    : dims_(mask.dimensions())
+    , count_(count)
+    , stride_(count * channels)
+    , sol_(dims_.x * dims_.y * stride_)
+    , rhs_(dims_.x * dims_.y * stride_)
+  {
+    if (count == 0)
+      throw std::runtime_error("at least one variant is required");
+    rect_ = find_mask_rectangle(mask, rect_top_left_, rect_dims_);
+
+    // точки, которые меняет poisson1, в том же порядке обхода
+    for (int y = 1; y + 1 < mask.height(); ++y)
+    {
+      auto imask = std::next(mask.row_begin(y));
+      for (int x = 1; x + 1 < mask.width(); ++x, ++imask)
+        if (*imask)
+          points_.push_back(size_t(y) * dims_.x + x);
+    }
+  }
+
+  // задает начальное приближение (вместе с границей) и правую часть варианта k
+  template <typename S, typename R>
+  void set(size_t k, const S & sol, const R & rhs)
+  {
+    if (sol.dimensions() != dims_ || rhs.dimensions() != dims_)
+      throw std::runtime_error("image dimensions shall be equal");
+    copy_pixels(sol, variant_view(sol_, k));
+    copy_pixels(rhs, variant_view(rhs_, k));
+  }
+
+  // аналог solve_poisson для всех вариантов сразу
+  void solve(int n)
+  {
+    if (rect_)
+    {
+      for (size_t k = 0; k < count_; ++k)
+        poisson_rect(rect_top_left_, rect_dims_, variant_view(sol_, k), variant_view(rhs_, k));
+      return;
+    }
+    for (int i = 0; i < n; ++i)
+      iterate();
+  }
+
+  // забирает решение варианта k
+  template <typename S>
+  void get(size_t k, const S & sol)
+  {
+    if (sol.dimensions() != dims_)
+      throw std::runtime_error("image dimensions shall be equal");
+    copy_pixels(variant_view(sol_, k), sol);
+  }
+
+private:
+  // представление варианта k в перемешанном буфере как обычного изображения
+  variant_view_t variant_view(std::vector<float> & buf, size_t k) const
+  {
+    if (k >= count_)
+      throw std::runtime_error("wrong variant index");
+    auto all = interleaved_view(dims_.x * count_, dims_.y,
+      reinterpret_cast<rgb32f_pixel_t *>(buf.data()), stride_ * dims_.x * sizeof(float));
+    return subsampled_view(subimage_view(all, int(k), 0, int(dims_.x * count_ - k), int(dims_.y)), int(count_), 1);
+  }
+
+  // одна итерация Гаусса-Зейделя сразу для всех вариантов (тот же порядок сложения, что и в poisson1)
+  void iterate()
+  {
+    PROFILE_SCOPE("poisson/batch_sweep");
+    const auto row = dims_.x * stride_;
+    const auto stride = stride_;
+    for (size_t i = 0; i < points_.size(); ++i)
+    {
+      float * u = &sol_[points_[i] * stride];
+      const float * r = &rhs_[points_[i] * stride];
+      const float * w = u - stride;
+      const float * e = u + stride;
+      const float * n = u + row;
+      const float * s = u - row;
+      for (size_t j = 0; j < stride; ++j)
+        u[j] = 0.25f * (w[j] + n[j] + s[j] + e[j] - r[j]);
+    }
+  }
+
+  point2<ptrdiff_t> dims_;
+  size_t count_, stride_;
+  std::vector<float> sol_, rhs_;
+  std::vector<size_t> points_;
+  bool rect_;
+  point2<ptrdiff_t> rect_top_left_, rect_dims_;
+};
+
+// вычисляет лапласиан данного изображения в каждой точке маски
+template <typename M, typename V, typename L>
+void get_laplacian(const M & mask, const V & img, const L & laplacian)
+{
+  if (img.dimensions() != mask.dimensions() || img.dimensions() != laplacian.dimensions())
+    throw std::runtime_error("image dimensions shall be equal");
+
+  auto img_cross = cross(img.xy_at(0, 0));
+
+  for (int y = 1; y + 1 < img.height(); ++y)
+  {
+    auto img_loc = img.xy_at(1, y);
+    auto imask = std::next(mask.row_begin(y));
+    auto il = std::next(laplacian.row_begin(y));
+    for (int x = 1; x + 1 < img.width(); ++x, ++imask, ++il, ++img_loc.x())
+    {
+      if (!*imask)
+        continue;
+      *il = img_loc[img_cross.w] + img_loc[img_cross.n] + img_loc[img_cross.s] + img_loc[img_cross.e] - 4 * *img_loc;
+    }
+  }
+}
+
+// вычисляет "лапласиан", используя максимальные по модулю разности из двух изображений
+template <typename M, typename V1, typename V2, typename L>
+void get_absmax_laplacian(const M & mask, const V1 & img1, const V2 & img2, const L & laplacian)
+{
+  if (img1.dimensions() != mask.dimensions() || img1.dimensions() != laplacian.dimensions() || img2.dimensions() != laplacian.dimensions())
+    throw std::runtime_error("image dimensions shall be equal");
+
+  auto img1_cross = cross(img1.xy_at(0, 0));
+  auto img2_cross = cross(img2.xy_at(0, 0));
+
+  for (int y = 1; y + 1 < img1.height(); ++y)
+  {
+    auto img1_loc = img1.xy_at(1, y);
+    auto img2_loc = img2.xy_at(1, y);
+    auto imask = std::next(mask.row_begin(y));
+    auto il = std::next(laplacian.row_begin(y));
+    for (int x = 1; x + 1 < img1.width(); ++x, ++imask, ++il, ++img1_loc.x(), ++img2_loc.x())
+    {
+      if (!*imask)
+        continue;
+      *il = 
+        absmax(img1_loc[img1_cross.w] - *img1_loc, img2_loc[img2_cross.w] - *img2_loc) +
+        absmax(img1_loc[img1_cross.n] - *img1_loc, img2_loc[img2_cross.n] - *img2_loc) +
+        absmax(img1_loc[img1_cross.s] - *img1_loc, img2_loc[img2_cross.s] - *img2_loc) +
+        absmax(img1_loc[img1_cross.e] - *img1_loc, img2_loc[img2_cross.e] - *img2_loc);
+    }
+  }
+}
+
+// помечаем пикселы маски рядом с правой границей числом 2
+template <typename M>
+void mark_xpos(const M & mask)
+{
+  for (int y = 0; y < mask.height(); ++y)
+  { 
+    auto i = mask.row_begin(y), iEnd = mask.row_end(y);
+    bool prev = false;
+    for (; i != iEnd; ++i)
+    {
+      bool curr = *i != 0;
+      if (!prev && curr)
+        *i = 2;
+      prev = curr;
+    }
+  }
+}
+
+// выедание пикселов маски со всех четырех сторон
+template <typename M>
+void erode(const M & mask)
+{
+  mark_xpos(mask);
+  mark_xpos(rotated180_view(mask));
+  mark_xpos(rotated90cw_view(mask));
+  mark_xpos(rotated90ccw_view(mask));
+  //замена 2 на 0
+  for (auto & p : mask) 
+    if (p == 2) 
+      p = 0;
+}
+
+// во сколько раз расстояние до участка границы должно превышать его длину, чтобы участок не разбивался дальше
+const float MVC_SUBDIVISION = 2.5f;
+// минимальное число точек в начальной разреженной выборке границы
+const size_t MVC_COARSE_SAMPLES = 16;
+
+// клонирование без решения системы уравнений - "мембрана" на координатах среднего значения:
+// https://www.cs.huji.ac.il/~danix/mvclone/files/mvc-final-opt.pdf
+// граница - точки вне маски, соседние с ней (в них после erode известен и объект, и фон);
+// веса зависят только от формы маски, поэтому считаются один раз в конструкторе,
+// а клонирование при каждом новом положении объекта - один проход по точкам маски;
+// внутренние дырки маски не учитываются, интерполяция идет только по внешнему контуру каждой компоненты
+class mvc_membrane
+{
+public:
+  using point_t = point2<ptrdiff_t>;
+
+  template <typename M>
+  explicit mvc_membrane(const M & mask)
+    : dims_(mask.dimensions())
+  {
+    PROFILE_SCOPE("poisson/mvc_weights");
+    // область = маска (1) и граница вокруг нее (2)
+    gray8_image_t region(dims_);
+    fill_pixels(view(region), gray8_pixel_t(0));
+    auto rv = view(region);
+    for (int y = 0; y < mask.height(); ++y)
+      for (int x = 0; x < mask.width(); ++x)
+      {
+        if (!mask(x, y))
+          continue;
+        rv(x, y) = 1;
+        for (auto d : { point_t(-1, 0), point_t(1, 0), point_t(0, -1), point_t(0, 1) })
+        {
+          point_t q(x + d.x, y + d.y);
+          if (inside(q) && !mask(q.x, q.y))
+            rv(q.x, q.y) = 2;
+        }
+      }
+
+    // обходим каждую 8-связную компоненту области
+    gray8_image_t visited(dims_);
+    fill_pixels(view(visited), gray8_pixel_t(0));
+    auto vv = view(visited);
+    for (int y = 0; y < region.height(); ++y)
+      for (int x = 0; x < region.width(); ++x)
+      {
+        if (!rv(x, y) || vv(x, y))
+          continue;
+        // первая в порядке развертки точка компоненты всегда лежит на ее внешнем контуре
+        auto first_boundary = boundary_.size();
+        trace_contour(const_view(region), point_t(x, y));
+        auto interior = flood_component(rv, vv, point_t(x, y));
+        for (const auto & p : interior)
+          add_point(p, first_boundary, boundary_.size());
+      }
+  }
+
+  // размещает объект source на фоне target и записывает результат в точки маски в result:
+  // result = source + мембрана, интерполирующая разность (target - source) с границы
+  template <typename S, typename T, typename O>
+  void clone(const S & source, const T & target, const O & result) const
+  {
+    PROFILE_SCOPE("poisson/mvc_clone");
+    if (source.dimensions() != dims_ || target.dimensions() != dims_ || result.dimensions() != dims_)
+      throw std::runtime_error("image dimensions shall be equal");
+
+    std::vector<rgb32f_pixel_t> diff(boundary_.size());
+    for (size_t i = 0; i < boundary_.size(); ++i)
+    {
+      const auto & b = boundary_[i];
+      diff[i] = target(b.x, b.y) - source(b.x, b.y);
+    }
+
+    for (size_t i = 0; i < points_.size(); ++i)
+    {
+      const auto & p = points_[i];
+      rgb32f_pixel_t r(0, 0, 0);
+      for (auto j = offsets_[i]; j < offsets_[i + 1]; ++j)
+        r += weights_[j] * diff[indices_[j]];
+      result(p.x, p.y) = source(p.x, p.y) + r;
+    }
+  }
+
+  size_t points() const { return points_.size(); }
+  size_t weights() const { return weights_.size(); }
+
+private:
+  bool inside(const point_t & p) const
+  {
+    return p.x >= 0 && p.y >= 0 && p.x < dims_.x && p.y < dims_.y;
+  }
+
+  // обход внешнего контура компоненты по соседям Мура (по часовой стрелке), начиная с верхней левой точки
+  template <typename R>
+  void trace_contour(const R & region, const point_t & start)
+  {
+    static const point_t dirs[8] = { { 1, 0 }, { 1, 1 }, { 0, 1 }, { -1, 1 }, { -1, 0 }, { -1, -1 }, { 0, -1 }, { 1, -1 } };
+    auto in_region = [&](const point_t & p) { return inside(p) && region(p.x, p.y) != 0; };
+    auto dir_index = [&](const point_t & d) { return int(std::find(std::begin(dirs), std::end(dirs), d) - std::begin(dirs)); };
+
+    boundary_.push_back(start);
+    point_t curr = start;
+    int back = 4; // слева от стартовой точки нет точек области
+    point_t second(-1, -1);
+    for (;;)
+    {
+      int found = -1;
+      for (int i = 1; i <= 8; ++i)
+      {
+        int d = (back + i) % 8;
+        if (in_region(curr + dirs[d]))
+        {
+          found = d;
+          break;
+        }
+      }
+      if (found < 0)
+        return; // одиночная точка
+
+      point_t next = curr + dirs[found];
+      // критерий остановки Джейкоба: вернулись в начало и собираемся повторить первый шаг
+      if (curr == start && next == second)
+        break;
+      if (second.x < 0)
+        second = next;
+
+      back = dir_index(curr + dirs[(found + 7) % 8] - next);
+      curr = next;
+      if (curr != start)
+        boundary_.push_back(curr);
+    }
+  }
+
+  // возвращает точки маски в 8-связной компоненте области, содержащей start
+  template <typename R, typename V>
+  std::vector<point_t> flood_component(const R & region, const V & visited, const point_t & start) const
+  {
+    std::vector<point_t> res, stack(1, start);
+    visited(start.x, start.y) = 1;
+    while (!stack.empty())
+    {
+      auto p = stack.back();
+      stack.pop_back();
+      if (region(p.x, p.y) == 1)
+        res.push_back(p);
+      for (int dy = -1; dy <= 1; ++dy)
+        for (int dx = -1; dx <= 1; ++dx)
+        {
+          point_t q(p.x + dx, p.y + dy);
+          if (inside(q) && region(q.x, q.y) && !visited(q.x, q.y))
+          {
+            visited(q.x, q.y) = 1;
+            stack.push_back(q);
+          }
+        }
+    }
+    return res;
+  }
+
+  // иерархическая выборка участка контура [i, i+len): вблизи точки p участок делится пополам,
+  // вдали берется одна его средняя точка - та же, до которой измерялось расстояние
+  void sample_boundary(const point_t & p, size_t first, size_t n, size_t i, size_t len, std::vector<size_t> & samples) const
+  {
+    auto mid = first + (i + len / 2) % n;
+    const auto & b = boundary_[mid];
+    float dx = float(b.x - p.x), dy = float(b.y - p.y);
+    if (len > 1 && dx * dx + dy * dy < MVC_SUBDIVISION * MVC_SUBDIVISION * len * len)
+    {
+      sample_boundary(p, first, n, i, len / 2, samples);
+      sample_boundary(p, first, n, i + len / 2, len - len / 2, samples);
+      return;
+    }
+    samples.push_back(mid);
+  }
+
+  // вычисляет нормированные координаты среднего значения точки p относительно выборки контура [first, last)
+  void add_point(const point_t & p, size_t first, size_t last)
+  {
+    auto n = last - first;
+    size_t step = 1;
+    while (n / (2 * step) >= MVC_COARSE_SAMPLES)
+      step *= 2;
+    std::vector<size_t> samples;
+    for (size_t i = 0; i < n; i += step)
+      sample_boundary(p, first, n, i, std::min(step, n - i), samples);
+
+    // векторы из p в точки выборки, их длины и тангенсы половин углов между соседними векторами
+    auto m = samples.size();
+    std::vector<float> vx(m), vy(m), len(m), tan_half(m);
+    for (size_t k = 0; k < m; ++k)
+    {
+      const auto & b = boundary_[samples[k]];
+      vx[k] = float(b.x - p.x);
+      vy[k] = float(b.y - p.y);
+      len[k] = std::sqrt(vx[k] * vx[k] + vy[k] * vy[k]);
+    }
+    // если маска касается края изображения, ее точка может лежать на самом контуре; там координаты
+    // вырождаются (деление на нулевую длину), а их предел - вес 1 у этой точки, то есть значение фона,
+    // как и у poisson1, который не меняет крайние строки и столбцы
+    for (size_t k = 0; k < m; ++k)
+      if (len[k] == 0)
+      {
+        indices_.push_back(samples[k]);
+        weights_.push_back(1);
+        points_.push_back(p);
+        offsets_.push_back(weights_.size());
+        return;
+      }
+    for (size_t k = 0; k < m; ++k)
+    {
+      auto k1 = (k + 1) % m;
+      // tg(a/2) = sin(a) / (1 + cos(a)) = (u x v) / (|u||v| + u.v)
+      float cross = vx[k] * vy[k1] - vy[k] * vx[k1];
+      float denom = len[k] * len[k1] + vx[k] * vx[k1] + vy[k] * vy[k1];
+      tan_half[k] = denom > 1e-6f ? cross / denom : 0;
+    }
+
+    auto begin = weights_.size();
+    float sum = 0;
+    for (size_t k = 0; k < m; ++k)
+    {
+      float w = (tan_half[(k + m - 1) % m] + tan_half[k]) / len[k];
+      indices_.push_back(samples[k]);
+      weights_.push_back(w);
+      sum += w;
+    }
+    if (sum != 0)
+      for (auto j = begin; j < weights_.size(); ++j)
+        weights_[j] /= sum;
+
+    points_.push_back(p);
+    offsets_.push_back(weights_.size());
+  }
+
+  point_t dims_;
+  std::vector<point_t> boundary_;         // точки контуров всех компонент подряд
+  std::vector<point_t> points_;           // точки маски
+  std::vector<size_t> offsets_ { 0 };     // веса точки i лежат в [offsets_[i], offsets_[i+1])
+  std::vector<size_t> indices_;           // номера точек контура
+  std::vector<float> weights_;
+};
+
+// функтор, который возвращает (0,0,0) для любой точки
+struct zero
+{
+  using argument_type = point2<ptrdiff_t>;
+  using value_type = rgb32f_pixel_t;
+  using reference  = rgb32f_pixel_t;
+  using const_t = zero;
+  rgb32f_pixel_t operator()(const point2<ptrdiff_t>&) const { return{ 0, 0, 0 }; }
+};
@@ -0,0 +1,689 @@
+#pragma once
+
+// geodesic image segmentation by generalized geodesic distance transform (GGDT)
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../gil_utils/lut.h"
+#include "../gil_utils/morphology.h"
+#include "../gil_utils/profile.h"
+#include "../gil_utils/tiled_image.h"
+
+const float MU = 5;
+const float NU = 100;
+const float GAMMA2 = 0.3f * 0.3f;
+const float TETHA_E = 10; //more white
+const float TETHA_D = 10; //more black
+
+// define images and view, those pixels are floats (unlike gray32f_pixel_t, which float limited in the range [0,1])
+namespace boost { namespace gil {
+#if BOOST_VERSION < 106800
+  typedef float bits32fu;
+  GIL_DEFINE_BASE_TYPEDEFS(32fu,gray)
+#else
+  BOOST_GIL_DEFINE_BASE_TYPEDEFS(32fu, float, gray)
+#endif
+} }
+
+// this type is implicitly convertible to/from gray32f_pixel_t and to/from float
+typedef channel_type<gray32f_view_t>::type pixel_float_t;
+
+// creates view that applies given functor to the base view
+template <typename ViewType, typename Functor>
+inline typename ViewType::template add_deref<Functor>::type function_view(const ViewType & view, const Functor & f)
+{
+  return ViewType::template add_deref<Functor>::make(view, f);
+}
+
+// prior probability of one intensity by the formula below Fig.6
+inline float prior_probability(unsigned char c)
+{
+  if (c == 0)
+    return 0;
+  if (c == 255)
+    return 1;
+  float p1 = (1.0f / 255) * c;
+  float p0 = 1 - p1;
+  float t = log(p1 / p0);
+  return 1 / (1 + exp(-t / MU));
+}
+
+// prior_probability for all 256 intensities, computed once
+inline const lut8<float> & prior_probability_lut()
+{
+  static const lut8<float> lut(prior_probability);
+  return lut;
+}
+
+// compute prior probability be the formula below Fig.6
+inline void find_prior_probability(const gray8c_view_t & pic, const gray32f_view_t & prob)
+{
+  apply_lut(pic, prob, prior_probability_lut());
+};
+
+// computes square of the gradient
+inline float sqr_diff(float a, float b)
+{
+  float d = a - b;
+  return d * d;
+}
+
+// if given value is less than stored in cell, then updates cell and increases the counter
+inline void updateDistance(float value, gray32fu_pixel_t & cell, int & changes)
+{
+  if (value < cell)
+  {
+    cell = value;
+    ++changes;
+  }
+}
+
+// makes one pass from left to right from top to bottom, updating the distance transform
+template <typename PicView, typename DView>
+int improve_ggdt_forward(const PicView & pic, const DView & d)
+{
+  PROFILE_SCOPE("segm/ggdt_sweep");
+  int changes = 0;
+
+  auto pic_loc = pic.xy_at(1, 0);
+  const auto pic_w = pic_loc.cache_location(-1,0);
+  const auto pic_nw = pic_loc.cache_location(-1,-1);
+  const auto pic_n = pic_loc.cache_location(0,-1);
+  const auto pic_ne = pic_loc.cache_location(1,-1);
+
+  auto d_loc = d.xy_at(1, 0);
+  const auto d_w = d_loc.cache_location(-1,0);
+  const auto d_nw = d_loc.cache_location(-1,-1);
+  const auto d_n = d_loc.cache_location(0,-1);
+  const auto d_ne = d_loc.cache_location(1,-1);
+
+  //process first row
+  for (int x = 1; x < pic.width(); ++x, ++pic_loc.x(), ++d_loc.x())
+  {
+    updateDistance(d_loc[d_w] + sqrt(1 + GAMMA2 * sqr_diff(pic_loc[pic_w], *pic_loc)),
+      *d_loc, changes);
+  }
+  
+  //process other rows
+  for (int y = 1; y < pic.height(); ++y)
+  {
+    pic_loc = pic.xy_at(0, y);
+    d_loc = d.xy_at(0, y);
+
+    //process first column
+    updateDistance(
+      std::min(
+        d_loc[d_n] + sqrt(1 + GAMMA2 * sqr_diff(pic_loc[pic_n], *pic_loc)),
+        d_loc[d_ne] + sqrt(2 + GAMMA2 * sqr_diff(pic_loc[pic_ne], *pic_loc))),
+      *d_loc, changes);
+
+    //process other columns
+    ++pic_loc.x(), ++d_loc.x();
+    for (int x = 1; x < pic.width(); ++x, ++pic_loc.x(), ++d_loc.x())
+    {
+      updateDistance(
+        std::min(std::min(std::min(
+          d_loc[d_w] + sqrt(1 + GAMMA2 * sqr_diff(pic_loc[pic_w], *pic_loc)),
+          d_loc[d_nw] + sqrt(2 + GAMMA2 * sqr_diff(pic_loc[pic_nw], *pic_loc))),
+          d_loc[d_n] + sqrt(1 + GAMMA2 * sqr_diff(pic_loc[pic_n], *pic_loc))),
+          d_loc[d_ne] + sqrt(2 + GAMMA2 * sqr_diff(pic_loc[pic_ne], *pic_loc))),
+        *d_loc, changes);
+    }
+  }
+
+  return changes;
+}
+
+// makes the pass from left to right from top to bottom, updating the distance transform,
+// and the pass in the opposite direction
+inline int improve_ggdt(const gray8c_view_t & pic, const gray32fu_view_t & d)
+{
+  return
+    improve_ggdt_forward(pic, d) +
+    improve_ggdt_forward(rotated180_view(pic), rotated180_view(d));
+}
+
+// makes passes until the distance transform stops changing
+inline void improve_ggdt_until_stable(const gray8c_view_t & pic, const gray32fu_view_t & d)
+{
+  const int MAX_ITERS = 10;
+  for (int i = 0; i < MAX_ITERS; ++i)
+  {
+    int changes = improve_ggdt(pic, d);
+    PROFILE_COUNT("segm/ggdt_changes", changes);
+    if (changes == 0)
+      return;
+  }
+}
+
+// computes generalized geodesic distance 
+template <typename ProbView>
+void find_ggdt(const gray8c_view_t & pic, const ProbView & prob, const gray32fu_view_t & d)
+{
+  //scale seed mask
+  transform_pixels(prob, d, [](pixel_float_t v) -> float { return NU * v; } );
+  improve_ggdt_until_stable(pic, d);
+}
+
+// the same for the seed mask given by a table of the intensity, already scaled by NU
+inline void find_ggdt(const gray8c_view_t & pic, const lut8<float> & seed, const gray32fu_view_t & d)
+{
+  apply_lut(pic, d, seed);
+  improve_ggdt_until_stable(pic, d);
+}
+
+// gray32f_pixel_t -> gray32f_pixel_t: y = 1 - x
+struct completer : deref_base<completer, gray32f_pixel_t, gray32f_pixel_t, const gray32f_pixel_t&, gray32f_pixel_t, gray32f_pixel_t, false> 
+{
+  gray32f_pixel_t operator()(pixel_float_t x) const 
+    { return gray32f_pixel_t(1 - x); }
+};
+
+// computes signed generalized geodesic distance
+inline void find_ds(const gray8c_view_t & pic, const gray32fc_view_t & prob, const gray32fu_view_t & ds)
+{
+  find_ggdt(pic, prob, ds);
+
+  gray32fu_image_t d(ds.dimensions());
+  find_ggdt(pic, function_view(prob, completer()), view(d));
+
+  //ds -= d;
+  transform_pixels(ds, const_view(d), ds,
+    [](float a, float b) -> float { return a - b; }
+  );
+}
+
+// find_ds for the prior probability of find_prior_probability without the probability image:
+// both seed masks are made from the intensities in one pass each by the fused tables
+inline void find_ds(const gray8c_view_t & pic, const gray32fu_view_t & ds)
+{
+  static const auto seed = prior_probability_lut().then([](float p) -> float { return NU * p; });
+  static const auto seed_complement = prior_probability_lut().then([](float p) -> float { return NU * (1 - p); });
+  find_ggdt(pic, seed, ds);
+
+  gray32fu_image_t d(ds.dimensions());
+  find_ggdt(pic, seed_complement, view(d));
+
+  //ds -= d;
+  transform_pixels(ds, const_view(d), ds,
+    [](float a, float b) -> float { return a - b; }
+  );
+}
+
+// gray32fu_pixel_t -> gray32f_pixel_t: computes y = (x > t) ? a : b
+class discretizor : public deref_base<discretizor, gray32f_pixel_t, gray32f_pixel_t, const gray32f_pixel_t&, float, gray32f_pixel_t, false> 
+{
+  float t, a, b;
+public:
+  discretizor(float t, float a, float b) : t(t), a(a), b(b) { }
+  gray32f_pixel_t operator()(float x) const 
+    { return gray32f_pixel_t(x > t ? a : b); }
+};
+
+// computes symmetric signed distance
+template <typename MView>
+void find_dss(const gray8c_view_t & pic, const MView & Me, const MView & notMd, const gray32fu_view_t & dss)
+{
+  find_ggdt(pic, Me, dss);
+
+  gray32fu_image_t d(dss.dimensions());
+  find_ggdt(pic, notMd, view(d));
+
+  //dss -= d + TETHA_D - TETHA_E;
+  transform_pixels(dss, const_view(d), dss,
+    [](float a, float b) -> float { return a - b + TETHA_D - TETHA_E; }
+  );
+}
+
+// ---- coarse-to-fine narrow-band mode ----
+// Only the signs of ds and dss relative to their thresholds matter for the segmentation, so the multiresolution
+// functions below solve the problem on a pyramid of 2x downsampled images, upsample the coarse difference
+// of distances and recompute it at the finer level only in a band around the level sets: pixels where the coarse
+// value changes its side or is closer than a margin to a threshold, widened by GGDT_BAND pixels.
+// Every GGDT value is at most NU, and every step costs at least 1, so an optimal path never leaves the square
+// of radius NU * (max seed - min seed) around its end point; running the sweeps on the band dilated by this halo
+// therefore gives exactly the values of find_ggdt inside the band (when both converge in MAX_ITERS iterations).
+// Outside the band the signs are taken from the coarser level. The gain is large on big images with mostly
+// homogeneous regions, where the band and its halo are a small part of the image.
+
+const int GGDT_LEVELS = 2;      //default number of coarse levels
+const int GGDT_BAND = 4;        //half-width of the refined band in pixels of each level
+const int GGDT_MIN_SIZE = 64;   //the pyramid is not built below this image side
+const double GGDT_MAX_BAND = 0.5; //a level with a wider band is solved everywhere
+const float GGDT_MARGIN_DS = 5;   //coarse ds closer than this to -TETHA_E or TETHA_D is refined
+const float GGDT_MARGIN_DSS = 20; //coarse dss closer than this to 0 is refined
+
+// consecutive pixels of a domain mask in each row, [first, second)
+typedef std::vector<std::vector<std::pair<int, int> > > pixel_runs;
+
+template <typename MaskView>
+pixel_runs find_runs(const MaskView & mask)
+{
+  pixel_runs runs(mask.height());
+  for (int y = 0; y < mask.height(); ++y)
+  {
+    auto it = mask.row_begin(y);
+    for (int x = 0; x < mask.width(); )
+    {
+      if (!it[x][0])
+      {
+        ++x;
+        continue;
+      }
+      int x0 = x;
+      while (x < mask.width() && it[x][0])
+        ++x;
+      runs[y].push_back(std::make_pair(x0, x));
+    }
+  }
+  return runs;
+}
+
+// the same pass as improve_ggdt_forward, but only over the domain pixels given by runs; pixels outside
+// of the domain shall hold +infinity, so they never improve their neighbours; h2 is the squared pixel size
+// (1 at full resolution); at the last column the north-east neighbour is the first pixel of the row,
+// exactly as improve_ggdt_forward reads it, so on the whole image both passes give identical values
+template <typename PicView, typename DView>
+int improve_ggdt_forward_in(const PicView & pic, const DView & d, const pixel_runs & runs, float h2)
+{
+  PROFILE_SCOPE("segm/ggdt_band_sweep");
+  int changes = 0;
+
+  auto pic_loc = pic.xy_at(0, 0);
+  const auto pic_w = pic_loc.cache_location(-1,0);
+  const auto pic_nw = pic_loc.cache_location(-1,-1);
+  const auto pic_n = pic_loc.cache_location(0,-1);
+  const auto pic_ne = pic_loc.cache_location(1,-1);
+
+  auto d_loc = d.xy_at(0, 0);
+  const auto d_w = d_loc.cache_location(-1,0);
+  const auto d_nw = d_loc.cache_location(-1,-1);
+  const auto d_n = d_loc.cache_location(0,-1);
+  const auto d_ne = d_loc.cache_location(1,-1);
+
+  //first row
+  for (const auto & run : runs[0])
+  {
+    pic_loc = pic.xy_at(run.first, 0);
+    d_loc = d.xy_at(run.first, 0);
+    for (int x = run.first; x < run.second; ++x, ++pic_loc.x(), ++d_loc.x())
+      if (x > 0)
+        updateDistance(d_loc[d_w] + sqrt(h2 + GAMMA2 * sqr_diff(pic_loc[pic_w], *pic_loc)), *d_loc, changes);
+  }
+
+  //other rows
+  for (int y = 1; y < pic.height(); ++y)
+  {
+    for (const auto & run : runs[y])
+    {
+      int x = run.first;
+      pic_loc = pic.xy_at(x, y);
+      d_loc = d.xy_at(x, y);
+      if (x == 0)
+      {
+        updateDistance(
+          std::min(
+            d_loc[d_n] + sqrt(h2 + GAMMA2 * sqr_diff(pic_loc[pic_n], *pic_loc)),
+            d_loc[d_ne] + sqrt(2 * h2 + GAMMA2 * sqr_diff(pic_loc[pic_ne], *pic_loc))),
+          *d_loc, changes);
+        ++x, ++pic_loc.x(), ++d_loc.x();
+      }
+      for (; x < run.second; ++x, ++pic_loc.x(), ++d_loc.x())
+      {
+        updateDistance(
+          std::min(std::min(std::min(
+            d_loc[d_w] + sqrt(h2 + GAMMA2 * sqr_diff(pic_loc[pic_w], *pic_loc)),
+            d_loc[d_nw] + sqrt(2 * h2 + GAMMA2 * sqr_diff(pic_loc[pic_nw], *pic_loc))),
+            d_loc[d_n] + sqrt(h2 + GAMMA2 * sqr_diff(pic_loc[pic_n], *pic_loc))),
+            d_loc[d_ne] + sqrt(2 * h2 + GAMMA2 * sqr_diff(pic_loc[pic_ne], *pic_loc))),
+          *d_loc, changes);
+      }
+    }
+  }
+
+  return changes;
+}
+
+// find_ggdt restricted to the domain pixels, the rest of d is filled with +infinity
+template <typename PicView, typename SeedView>
+void find_ggdt_in(const PicView & pic, const SeedView & seed, const gray32fu_view_t & d,
+  const pixel_runs & runs, const pixel_runs & runs180, float h2)
+{
+  //scale seed mask
+  fill_pixels(d, gray32fu_pixel_t(std::numeric_limits<float>::infinity()));
+  auto scale = [](pixel_float_t v) -> float { return NU * v; };
+  #pragma omp parallel for
+  for (int y = 0; y < d.height(); ++y)
+    for (const auto & run : runs[y])
+      for (int x = run.first; x < run.second; ++x)
+        d(x, y) = scale(seed(x, y));
+
+  const int MAX_ITERS = 10;
+  for (int i = 0; i < MAX_ITERS; ++i)
+  {
+    int changes =
+      improve_ggdt_forward_in(pic, d, runs, h2) +
+      improve_ggdt_forward_in(rotated180_view(pic), rotated180_view(d), runs180, h2);
+    PROFILE_COUNT("segm/ggdt_changes", changes);
+    if (changes == 0)
+      return;
+  }
+}
+
+// halves the resolution by 2x2 blocks (the last row and column of odd-sized views have smaller blocks):
+// intensities are averaged, and seeds take the minimum, so that thin seed regions survive on the coarse level
+template <typename SrcView, typename DstView>
+void downsample2(const SrcView & src, const DstView & dst, bool minimum)
+{
+  #pragma omp parallel for
+  for (int y = 0; y < dst.height(); ++y)
+  {
+    for (int x = 0; x < dst.width(); ++x)
+    {
+      float sum = 0, lo = std::numeric_limits<float>::max();
+      int n = 0;
+      for (int yy = 2 * y; yy < std::min<int>(2 * y + 2, src.height()); ++yy)
+        for (int xx = 2 * x; xx < std::min<int>(2 * x + 2, src.width()); ++xx, ++n)
+        {
+          float v = src(xx, yy)[0];
+          sum += v;
+          lo = std::min(lo, v);
+        }
+      dst(x, y)[0] = minimum ? lo : sum / n;
+    }
+  }
+}
+
+// max - min of a seed view, sets the radius of the influence of any pixel on GGDT
+template <typename SeedView>
+float seed_range(const SeedView & seed)
+{
+  float lo = 1, hi = 0;
+  for (int y = 0; y < seed.height(); ++y)
+    for (int x = 0; x < seed.width(); ++x)
+    {
+      float v = seed(x, y)[0];
+      lo = std::min(lo, v);
+      hi = std::max(hi, v);
+    }
+  return std::max(0.0f, hi - lo);
+}
+
+// marks pixels closer than margin to one of the level sets {out = t} or having a 4-neighbour on its other side,
+// widens them by r pixels, and returns the fraction of marked pixels
+inline double find_level_band(const gray32fuc_view_t & out, const std::vector<float> & level_sets, float margin, int r, const gray8_view_t & band)
+{
+  const int w = int(out.width()), h = int(out.height());
+  #pragma omp parallel for
+  for (int y = 0; y < h; ++y)
+  {
+    auto o = out.row_begin(y), up = out.row_begin(std::max(y - 1, 0)), down = out.row_begin(std::min(y + 1, h - 1));
+    auto b = band.row_begin(y);
+    for (int x = 0; x < w; ++x)
+    {
+      float v = o[x];
+      float lo = std::min(std::min(v, std::min(up[x][0], down[x][0])), std::min(o[std::max(x - 1, 0)][0], o[std::min(x + 1, w - 1)][0]));
+      float hi = std::max(std::max(v, std::max(up[x][0], down[x][0])), std::max(o[std::max(x - 1, 0)][0], o[std::min(x + 1, w - 1)][0]));
+      bool in_band = false;
+      for (float t : level_sets)
+        in_band = in_band || (lo <= t && t < hi) || std::abs(v - t) < margin;
+      b[x] = in_band ? 255 : 0;
+    }
+  }
+  dilate(band, r);
+
+  long long marked = 0;
+  #pragma omp parallel for reduction(+:marked)
+  for (int y = 0; y < h; ++y)
+    marked += std::count_if(band.row_begin(y), band.row_end(y), [](const gray8_pixel_t & p) { return p[0] != 0; });
+  return double(marked) / (double(w) * h);
+}
+
+// widens the band by the halo; as improve_ggdt_forward connects the first and the last pixels of each row,
+// the halo is also grown around such pixels on the opposite side until the domain stops growing
+inline void find_ggdt_domain(const gray8c_view_t & band, int halo, const gray8_view_t & domain)
+{
+  copy_pixels(band, domain);
+  dilate(domain, halo);
+  const int last = int(domain.width()) - 1;
+  gray8_image_t extra;
+  for (;;)
+  {
+    bool grows = false;
+    for (int y = 0; y < domain.height() && !grows; ++y)
+      grows = (domain(0, y)[0] != 0) != (domain(last, y)[0] != 0);
+    if (!grows)
+      return;
+    extra.recreate(domain.dimensions());
+    fill_pixels(view(extra), gray8_pixel_t(0));
+    for (int y = 0; y < domain.height(); ++y)
+    {
+      if (domain(0, y)[0] && !domain(last, y)[0])
+        view(extra)(last, y) = gray8_pixel_t(255);
+      if (domain(last, y)[0] && !domain(0, y)[0])
+        view(extra)(0, y) = gray8_pixel_t(255);
+    }
+    dilate(view(extra), halo);
+    transform_pixels(const_view(extra), domain, domain,
+      [](const gray8_pixel_t & a, const gray8_pixel_t & b) { return gray8_pixel_t(std::max(a[0], b[0])); });
+  }
+}
+
+// out = combine(ggdt(a), ggdt(b)), exact in the band around the given level sets of out and approximate elsewhere;
+// margin - the coarse values closer than it to a level set are not trusted, levels - number of coarser pyramid levels,
+// h2 - squared pixel size in pixels of the original image
+template <typename PicView, typename SeedA, typename SeedB, typename Combine>
+void find_ggdt_difference_multires(const PicView & pic, const SeedA & a, const SeedB & b, const gray32fu_view_t & out,
+  Combine combine, const std::vector<float> & level_sets, float margin, int levels, float h2)
+{
+  auto dim = pic.dimensions();
+  gray8_image_t band(dim), domain(dim);
+  bool whole = true;
+  if (levels > 0 && std::min(dim.x, dim.y) >= 2 * GGDT_MIN_SIZE)
+  {
+    point2<ptrdiff_t> coarse_dim((dim.x + 1) / 2, (dim.y + 1) / 2);
+    gray32fu_image_t coarse_pic(coarse_dim), coarse_out(coarse_dim);
+    gray32f_image_t coarse_a(coarse_dim), coarse_b(coarse_dim);
+    downsample2(pic, view(coarse_pic), false);
+    downsample2(a, view(coarse_a), true);
+    downsample2(b, view(coarse_b), true);
+    find_ggdt_difference_multires(const_view(coarse_pic), const_view(coarse_a), const_view(coarse_b), view(coarse_out),
+      combine, level_sets, margin, levels - 1, 4 * h2);
+
+    //upsample
+    auto cv = const_view(coarse_out);
+    #pragma omp parallel for
+    for (int y = 0; y < out.height(); ++y)
+    {
+      auto o = out.row_begin(y);
+      auto c = cv.row_begin(y / 2);
+      for (int x = 0; x < out.width(); ++x)
+        o[x] = c[x / 2];
+    }
+
+    //when the band covers most of the image, it is cheaper to solve everywhere
+    if (find_level_band(out, level_sets, margin, GGDT_BAND, view(band)) < GGDT_MAX_BAND)
+    {
+      int halo = int(std::ceil(NU * std::max(seed_range(a), seed_range(b)) / std::sqrt(h2))) + 1;
+      find_ggdt_domain(const_view(band), halo, view(domain));
+      whole = false;
+    }
+  }
+  if (whole)
+  {
+    fill_pixels(view(band), gray8_pixel_t(255));
+    fill_pixels(view(domain), gray8_pixel_t(255));
+  }
+
+  auto runs = find_runs(const_view(domain));
+  auto runs180 = find_runs(rotated180_view(const_view(domain)));
+  size_t area = 0;
+  for (const auto & row : runs)
+    for (const auto & run : row)
+      area += run.second - run.first;
+  PROFILE_COUNT("segm/ggdt_band_pixels", area);
+
+  gray32fu_image_t da(dim), db(dim);
+  find_ggdt_in(pic, a, view(da), runs, runs180, h2);
+  find_ggdt_in(pic, b, view(db), runs, runs180, h2);
+
+  #pragma omp parallel for
+  for (int y = 0; y < out.height(); ++y)
+  {
+    auto o = out.row_begin(y);
+    auto m = const_view(band).row_begin(y);
+    auto ia = const_view(da).row_begin(y), ib = const_view(db).row_begin(y);
+    for (int x = 0; x < out.width(); ++x)
+      if (m[x][0])
+        o[x] = combine(ia[x][0], ib[x][0]);
+  }
+}
+
+// find_ds in the coarse-to-fine mode: exact in the bands around ds = -TETHA_E and ds = TETHA_D,
+// where the seeds of find_dss are decided;
+// find_ds usually converges in one sweep pair at full resolution, so there is nothing to save and this is
+// about 3x slower than find_ds on the bench images; use find_ds, this variant is kept for comparison in bench
+inline void find_ds_multires(const gray8c_view_t & pic, const gray32fc_view_t & prob, const gray32fu_view_t & ds, int levels = GGDT_LEVELS)
+{
+  find_ggdt_difference_multires(pic, prob, function_view(prob, completer()), ds,
+    [](float a, float b) -> float { return a - b; }, { -TETHA_E, TETHA_D }, GGDT_MARGIN_DS, levels, 1.0f);
+}
+
+// find_dss in the coarse-to-fine mode: exact in the band around dss = 0, where the segmentation boundary is
+template <typename MView>
+void find_dss_multires(const gray8c_view_t & pic, const MView & Me, const MView & notMd, const gray32fu_view_t & dss, int levels = GGDT_LEVELS)
+{
+  find_ggdt_difference_multires(pic, Me, notMd, dss,
+    [](float a, float b) -> float { return a - b + TETHA_D - TETHA_E; }, { 0.0f }, GGDT_MARGIN_DSS, levels, 1.0f);
+}
+
+// ---- out-of-core mode ----
+// The same computations over images stored in files by tiles (tiled_image.h), for pictures that do not fit in memory
+// together with their distance images. Every pass goes over strips of one tile row: the forward pass from top
+// to bottom with one halo row above the strip, the backward pass from bottom to top with one halo row below.
+// The halo row is already final for the pass, and improve_ggdt_forward leaves it unchanged, so the distances
+// and the numbers of changes are exactly those of the in-memory functions. The strip buffers are contiguous
+// like the images, so the ne neighbour of the last column wraps to the same pixel.
+
+typedef tiled_image<gray8_pixel_t> tiled_gray8_t;
+typedef tiled_image<gray32fu_pixel_t> tiled_gray32fu_t;
+
+// one pass of improve_ggdt over the tiled images: forward, or backward in the rotated images
+inline int improve_ggdt_tiled(const tiled_gray8_t & pic, tiled_gray32fu_t & d, bool backward)
+{
+  strip_buffer<gray8_image_t> pic_buf;
+  strip_buffer<gray32fu_image_t> d_buf;
+  int changes = 0;
+  for_each_strip(d.height(), d.tile_size(), 1, backward, [&](const tile_strip & s)
+  {
+    pic.prefetch_rows(s.next_top, s.next_bottom);
+    d.prefetch_rows(s.next_top, s.next_bottom);
+    auto p = pic_buf.load(pic, s);
+    auto dv = d_buf.load(d, s);
+    //the halo row on the other side of the strip is not reached by the pass yet
+    int y0 = backward ? s.y0 - s.top : 0;
+    int y1 = backward ? s.bottom - s.top : s.y1 - s.top;
+    auto ps = subimage_view(p, 0, y0, p.width(), y1 - y0);
+    auto ds = subimage_view(dv, 0, y0, dv.width(), y1 - y0);
+    changes += backward ?
+      improve_ggdt_forward(rotated180_view(ps), rotated180_view(ds)) :
+      improve_ggdt_forward(ps, ds);
+    d_buf.store(d, s);
+    pic.release_rows(s.y0, s.y1);
+    d.release_rows(s.y0, s.y1);
+  });
+  return changes;
+}
+
+// improve_ggdt_until_stable for the tiled images
+inline void improve_ggdt_until_stable_tiled(const tiled_gray8_t & pic, tiled_gray32fu_t & d)
+{
+  const int MAX_ITERS = 10;
+  for (int i = 0; i < MAX_ITERS; ++i)
+  {
+    int changes = improve_ggdt_tiled(pic, d, false) + improve_ggdt_tiled(pic, d, true);
+    PROFILE_COUNT("segm/ggdt_changes", changes);
+    if (changes == 0)
+      return;
+  }
+}
+
+// computes generalized geodesic distance for the seed mask written by seed(strip, pic rows, d rows)
+// into the rows [strip.y0, strip.y1)
+template <typename Seed>
+void find_ggdt_tiled(const tiled_gray8_t & pic, tiled_gray32fu_t & d, Seed seed)
+{
+  if (pic.dimensions() != d.dimensions() || pic.tile_size() != d.tile_size())
+    throw std::runtime_error("image dimensions shall be equal");
+  strip_buffer<gray8_image_t> pic_buf;
+  strip_buffer<gray32fu_image_t> d_buf;
+  for_each_strip(d.height(), d.tile_size(), 0, false, [&](const tile_strip & s)
+  {
+    pic.prefetch_rows(s.next_top, s.next_bottom);
+    auto dv = d_buf.load(d, s);
+    seed(s, pic_buf.load(pic, s), dv);
+    d_buf.store(d, s);
+    pic.release_rows(s.y0, s.y1);
+    d.release_rows(s.y0, s.y1);
+  });
+  improve_ggdt_until_stable_tiled(pic, d);
+}
+
+// a = combine(a, b) strip by strip
+template <typename Combine>
+void combine_tiled(tiled_gray32fu_t & a, const tiled_gray32fu_t & b, Combine combine)
+{
+  strip_buffer<gray32fu_image_t> a_buf, b_buf;
+  for_each_strip(a.height(), a.tile_size(), 0, false, [&](const tile_strip & s)
+  {
+    a.prefetch_rows(s.next_top, s.next_bottom);
+    b.prefetch_rows(s.next_top, s.next_bottom);
+    auto av = a_buf.load(a, s);
+    transform_pixels(av, b_buf.load(b, s), av, combine);
+    a_buf.store(a, s);
+    a.release_rows(s.y0, s.y1);
+    b.release_rows(s.y0, s.y1);
+  });
+}
+
+// find_ds(pic, ds) for the tiled images; the second distance is kept in the temporary file scratch
+inline void find_ds_tiled(const tiled_gray8_t & pic, tiled_gray32fu_t & ds, const std::string & scratch)
+{
+  static const auto seed = prior_probability_lut().then([](float p) -> float { return NU * p; });
+  static const auto seed_complement = prior_probability_lut().then([](float p) -> float { return NU * (1 - p); });
+  find_ggdt_tiled(pic, ds, [](const tile_strip &, const gray8c_view_t & p, const gray32fu_view_t & out) { apply_lut(p, out, seed); });
+
+  tiled_gray32fu_t d(scratch, ds.dimensions(), true, ds.tile_size());
+  find_ggdt_tiled(pic, d, [](const tile_strip &, const gray8c_view_t & p, const gray32fu_view_t & out) { apply_lut(p, out, seed_complement); });
+
+  //ds -= d;
+  combine_tiled(ds, d, [](float a, float b) -> float { return a - b; });
+}
+
+// find_dss for the seed masks Me and notMd made from ds of find_ds_tiled, as in segmentation.cpp
+inline void find_dss_tiled(const tiled_gray8_t & pic, const tiled_gray32fu_t & ds, tiled_gray32fu_t & dss, const std::string & scratch)
+{
+  if (ds.dimensions() != dss.dimensions() || ds.tile_size() != dss.tile_size())
+    throw std::runtime_error("image dimensions shall be equal");
+  strip_buffer<gray32fu_image_t> ds_buf;
+  auto seed = [&](float t, float a, float b)
+  {
+    return [&ds, &ds_buf, t, a, b](const tile_strip & s, const gray8c_view_t &, const gray32fu_view_t & d)
+    {
+      transform_pixels(function_view(ds_buf.load(ds, s), discretizor(t, a, b)), d, [](pixel_float_t v) -> float { return NU * v; });
+      ds.release_rows(s.y0, s.y1);
+    };
+  };
+  find_ggdt_tiled(pic, dss, seed(-TETHA_E, 1, 0));
+
+  tiled_gray32fu_t d(scratch, dss.dimensions(), true, dss.tile_size());
+  find_ggdt_tiled(pic, d, seed(TETHA_D, 0, 1));
+
+  //dss -= d + TETHA_D - TETHA_E;
+  combine_tiled(dss, d, [](float a, float b) -> float { return a - b + TETHA_D - TETHA_E; });
+}
@@ -0,0 +1,372 @@
+﻿#pragma once
+
+// прямое и обратное вейвлет-преобразования цветных изображений
+
+#include <cassert>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "../gil_utils/color_arithm.h"
+#include "../gil_utils/pixel_expr.h"
+#include "../gil_utils/planar_arithm.h"
+#include "../gil_utils/profile.h"
+
+// итератор, подобный I, но который при достижении конца перескакивает на начало
+template <typename I>
+class cycle_iterator
+{
+  I begin_, end_, curr_;
+public:
+  cycle_iterator(I begin, I end, I curr) : begin_(begin), end_(end), curr_(curr) { assert (curr_ != end_);  }
+  auto operator *() const -> decltype(*curr_) { return *curr_; }
+  cycle_iterator & operator ++()
+  {
+    if (++curr_ == end_)
+      curr_ = begin_;
+    return *this;
+  }
+  cycle_iterator operator ++(int)
+  {
+    cycle_iterator tmp = *this;
+    ++*this;
+    return tmp;
+  }
+};
+
+template <typename I>
+inline cycle_iterator<I> create_cycle_iterator(I begin, I end, I curr)
+{
+  return cycle_iterator<I>(begin, end, curr);
+}
+
+// делает свертку входного изображения по строкам с заданным фильтром;
+// во входном изображении шагает на 2 пиксела по X
+// shift - значение, добавляемое к результирующим писелам, для того чтобы 0 в высокачастотном фильтре выглядел серым
+template <typename VI, typename VO>
+void convolve_downsample_x(const VI & in, const VO & out, const std::vector<float> & filter, float shift)
+{
+  if (in.width()/2 != out.width())
+    throw std::runtime_error("half of input image width is not equal to output image width");
+  if (in.height() != out.height())
+    throw std::runtime_error("input image height is not equal to output image height");
+
+  auto step_back = (filter.size() - 1) / 2;
+  #pragma omp parallel for
+  for (int y = 0; y < out.height(); ++y)
+  {
+    auto i = in.row_begin(y);
+    auto i_end = in.row_end(y);
+    auto is = create_cycle_iterator(i, i_end, step_back > 0 ? i_end - step_back : i);
+    auto o = out.row_begin(y);
+    for (; i < i_end; ++++i, ++++is, ++o)
+    {
+      rgb32f_pixel_t sum(shift, shift, shift);
+      auto ii = is;
+      for (auto f : filter)
+        sum += f * *ii++;
+      *o = sum;
+    }
+  }
+}
+
+// аналог для сертки по столбцам
+template <typename VI, typename VO>
+void convolve_downsample_y(const VI & in, const VO & out, const std::vector<float> & filter, float shift)
+{
+  convolve_downsample_x(transposed_view(in), transposed_view(out), filter, shift);
+}
+
+// рабочие изображения преобразований: если передавать один и тот же workspace в повторные вызовы
+// (как делает worker между заданиями), память под них выделяется только при росте размера изображения;
+// Buffer - тип промежуточных изображений (rgb16f_image_t из half_float.h вдвое уменьшает их объем)
+template <typename Buffer = rgb32f_image_t>
+struct wavelet_workspace
+{
+  Buffer filtered_x;           // разложение по X одного уровня
+  rgb32f_image_t inverted_y;   // обратное преобразование по Y одного уровня, всегда в fp32
+  std::deque<Buffer> copies;   // копии низких частот (прямое) или входа (обратное) для каждого уровня
+
+  Buffer & copy(int level)
+  {
+    if (copies.size() <= size_t(level))
+      copies.resize(level + 1);
+    return copies[level];
+  }
+};
+
+// один уровень вейвлет разложения; filtered_x - промежуточное изображение
+template <typename Buffer, typename VI, typename VO>
+void wavelet_transform1(const VI & in, const VO & out, const std::vector<float> & low_pass, const std::vector<float> & hi_pass, Buffer & filtered_x)
+{
+  PROFILE_SCOPE("wavelet/forward_level");
+  if (in.dimensions() != out.dimensions())
+    throw std::runtime_error("input and output images shall have the same dimensions in wavelet_transform");
+
+  // разложение по X
+  filtered_x.recreate(in.dimensions());
+  convolve_downsample_x(in,
+    subimage_view(view(filtered_x), { 0, 0 }, { in.width() / 2, in.height() }), low_pass, 0);
+  convolve_downsample_x(in,
+    subimage_view(view(filtered_x), { in.width() / 2, 0 }, { in.width() / 2, in.height() }), hi_pass, 0.5f);
+
+  // разложение по Y
+  convolve_downsample_y(view(filtered_x),
+    subimage_view(out, { 0, 0 }, { in.width(), in.height() / 2 }), low_pass, 0);
+  convolve_downsample_y(view(filtered_x),
+    subimage_view(out, { 0, in.height() / 2 }, { in.width(), in.height() / 2 }), hi_pass, 0.5f);
+}
+
+// то же с промежуточным изображением типа Buffer, которое создается на время вызова
+template <typename Buffer = rgb32f_image_t, typename VI, typename VO>
+void wavelet_transform1(const VI & in, const VO & out, const std::vector<float> & low_pass, const std::vector<float> & hi_pass)
+{
+  Buffer filtered_x;
+  wavelet_transform1(in, out, low_pass, hi_pass, filtered_x);
+}
+
+// вейвлет разложение с заданным числом уровней с рабочими изображениями из ws
+template <typename Buffer, typename VI, typename VO>
+void wavelet_transform(int levels, const VI & in, const VO & out, const std::vector<float> & low_pass, const std::vector<float> & hi_pass,
+  wavelet_workspace<Buffer> & ws)
+{
+  if (levels < 1)
+    throw std::runtime_error("at least 1 level of transform is required");
+
+  wavelet_transform1(in, out, low_pass, hi_pass, ws.filtered_x);
+  if (levels == 1)
+    return;
+
+  point2<ptrdiff_t> half_dim(out.width()/2, out.height()/2);
+  auto low_freq_out = subimage_view(out, { 0, 0 }, half_dim);
+
+  Buffer & tmp = ws.copy(levels - 1);
+  tmp.recreate(half_dim);
+  copy_pixels(low_freq_out, view(tmp));
+  wavelet_transform(levels-1, view(tmp), low_freq_out, low_pass, hi_pass, ws);
+}
+
+// вейвлет разложение с заданным числом уровней
+template <typename Buffer = rgb32f_image_t, typename VI, typename VO>
+void wavelet_transform(int levels, const VI & in, const VO & out, const std::vector<float> & low_pass, const std::vector<float> & hi_pass)
+{
+  wavelet_workspace<Buffer> ws;
+  wavelet_transform(levels, in, out, low_pass, hi_pass, ws);
+}
+
+// вейвлет разложение планарного изображения (planar_arithm.h): свертки идут по непрерывным строкам каналов,
+// а по Y строки результата накапливаются из строк входа вместо обхода столбцов;
+// результат до бита совпадает с wavelet_transform для того же изображения в rgb32f
+inline void wavelet_transform_planar(int levels, const rgb32fc_planar_view_t & in, const rgb32f_planar_view_t & out,
+  const std::vector<float> & low_pass, const std::vector<float> & hi_pass)
+{
+  if (levels < 1)
+    throw std::runtime_error("at least 1 level of transform is required");
+  if (in.dimensions() != out.dimensions())
+    throw std::runtime_error("input and output images shall have the same dimensions in wavelet_transform");
+
+  const int w = int(in.width()), h = int(in.height());
+  {
+    PROFILE_SCOPE("wavelet/forward_level_planar");
+    rgb32f_planar_image_t filtered_x(in.dimensions(), PLANAR_ALIGNMENT);
+    planar_convolve_downsample_x(in, subimage_view(view(filtered_x), 0, 0, w / 2, h), low_pass, 0);
+    planar_convolve_downsample_x(in, subimage_view(view(filtered_x), w / 2, 0, w / 2, h), hi_pass, 0.5f);
+    planar_convolve_downsample_y(const_view(filtered_x), subimage_view(out, 0, 0, w, h / 2), low_pass, 0);
+    planar_convolve_downsample_y(const_view(filtered_x), subimage_view(out, 0, h / 2, w, h / 2), hi_pass, 0.5f);
+  }
+  if (levels == 1)
+    return;
+
+  auto low_freq_out = subimage_view(out, 0, 0, w / 2, h / 2);
+  rgb32f_planar_image_t tmp(low_freq_out.dimensions(), PLANAR_ALIGNMENT);
+  copy_pixels(low_freq_out, view(tmp));
+  wavelet_transform_planar(levels - 1, const_view(tmp), low_freq_out, low_pass, hi_pass);
+}
+
+// делает свертку входного изображения по строкам с заданным фильтром;
+// в выходном изображении шагает на 2 пиксела по X;
+// shift - значение, вычитаемое из входных пикселов, чтобы принимать серый цвет в качестве 0 для высоких частот
+template <typename VI, typename VO>
+void convolve_upsample_x(const VI & in, const VO & out, const std::vector<float> & filter, float shift)
+{
+  if (in.width() != out.width() / 2)
+    throw std::runtime_error("half of output image width is not equal to input image width");
+  if (in.height() != out.height())
+    throw std::runtime_error("output image heightis not equal to input image height");
+
+  auto step_back = (filter.size() - 1) / 2;
+  #pragma omp parallel for
+  for (int y = 0; y < in.height(); ++y)
+  {
+    auto o = out.row_begin(y);
+    auto o_end = out.row_end(y);
+    auto os = create_cycle_iterator(o, o_end, step_back > 0 ? o_end - step_back : o);
+    auto i = in.row_begin(y);
+    for (; o < o_end; ++i, ++++o, ++++os)
+    {
+      auto inval = *i - rgb32f_pixel_t(shift, shift, shift);
+      auto oo = os;
+      // expr: выход может быть и в rgb16f (half_float.h), к которому rgb32f_pixel_t не прибавляется
+      for (auto f : filter)
+        *oo++ += f * expr(inval);
+    }
+  }
+}
+
+// аналог для сертки по столбцам
+template <typename VI, typename VO>
+void convolve_upsample_y(const VI & in, const VO & out, const std::vector<float> & filter, float shift)
+{
+  convolve_upsample_x(transposed_view(in), transposed_view(out), filter, shift);
+}
+
+// один уровень обратного вейвлет разложения; inverted_y - промежуточное изображение
+template <typename VI, typename VO>
+void inverse_transform1(const VI & in, const VO & out, const std::vector<float> & low_pass, const std::vector<float> & hi_pass, rgb32f_image_t & inverted_y)
+{
+  PROFILE_SCOPE("wavelet/inverse_level");
+  if (in.dimensions() != out.dimensions())
+    throw std::runtime_error("input and output images shall have the same dimensions in inverse_transform");
+  auto half_width = out.width() / 2;
+  auto half_height = out.height() / 2;
+
+  // обратное преобразование по Y; сюда суммируются вклады обоих фильтров, поэтому буфер всегда в fp32
+  inverted_y.recreate(in.dimensions());
+  fill_pixels(view(inverted_y), rgb32f_pixel_t(0, 0, 0));
+  convolve_upsample_y(subimage_view(in, { 0, 0 }, { in.width(), half_height }),
+    view(inverted_y), low_pass, 0);
+  convolve_upsample_y(subimage_view(in, { 0, half_height }, { in.width(), half_height }),
+    view(inverted_y), hi_pass, 0.5f);
+
+  // обратное преобразование по X
+  fill_pixels(out, rgb32f_pixel_t(0, 0, 0));
+  convolve_upsample_x(subimage_view(const_view(inverted_y), { 0, 0 }, { half_width, in.height() }),
+    out, low_pass, 0);
+  convolve_upsample_x(subimage_view(const_view(inverted_y), { half_width, 0 }, { half_width, in.height() }),
+    out, hi_pass, 0.5f);
+}
+
+// то же с промежуточным изображением, которое создается на время вызова
+template <typename VI, typename VO>
+void inverse_transform1(const VI & in, const VO & out, const std::vector<float> & low_pass, const std::vector<float> & hi_pass)
+{
+  rgb32f_image_t inverted_y;
+  inverse_transform1(in, out, low_pass, hi_pass, inverted_y);
+}
+
+// обратное вейвлет разложение с заданным числом уровней с рабочими изображениями из ws;
+// в копиях входа типа Buffer восстанавливаются низкие частоты
+template <typename Buffer, typename VI, typename VO>
+void inverse_transform(int levels, const VI & in, const VO & out, const std::vector<float> & low_pass, const std::vector<float> & hi_pass,
+  wavelet_workspace<Buffer> & ws)
+{
+  if (levels < 1)
+    throw std::runtime_error("at least 1 level of transform is required");
+
+  if (levels == 1)
+  {
+    inverse_transform1(in, out, low_pass, hi_pass, ws.inverted_y);
+    return;
+  }
+
+  point2<ptrdiff_t> half_dim(out.width() / 2, out.height() / 2);
+
+  Buffer & tmp = ws.copy(levels - 1);
+  tmp.recreate(in.dimensions());
+  copy_pixels(in, view(tmp));
+  inverse_transform(levels - 1, subimage_view(in, { 0, 0 }, half_dim), subimage_view(view(tmp), { 0, 0 }, half_dim), low_pass, hi_pass, ws);
+
+  inverse_transform1(view(tmp), out, low_pass, hi_pass, ws.inverted_y);
+}
+
+// обратное вейвлет разложение с заданным числом уровней;
+// Buffer - тип копии входа, в которой восстанавливаются низкие частоты
+template <typename Buffer = rgb32f_image_t, typename VI, typename VO>
+void inverse_transform(int levels, const VI & in, const VO & out, const std::vector<float> & low_pass, const std::vector<float> & hi_pass)
+{
+  wavelet_workspace<Buffer> ws;
+  inverse_transform(levels, in, out, low_pass, hi_pass, ws);
+}
+
+// меняет знак у каждого второго элемента вектора, начиная с данного
+inline void negate_every_second(std::vector<float> & vec, size_t i)
+{
+  for (; i < vec.size(); i += 2)
+    vec[i] = -vec[i];
+}
+
+// фильтры анализа и синтеза одного вейвлет базиса
+struct wavelet_filters
+{
+  std::vector<float> low_pass_analysis, hi_pass_analysis, low_pass_synthesis, hi_pass_synthesis;
+};
+
+// для ортогонального базиса
+inline wavelet_filters orthogonal_filters(const std::vector<float> & low_pass_synthesis)
+{
+  wavelet_filters f;
+  f.low_pass_synthesis = low_pass_synthesis;
+
+  // высокочастотный фильтр получается из низкочастотного изменением порядка коэффициентов и знака у каждого второго из них
+  f.hi_pass_synthesis.assign(low_pass_synthesis.rbegin(), low_pass_synthesis.rend());
+  negate_every_second(f.hi_pass_synthesis, 1);
+
+  // фильтры для анализа и синтеза отличаются на множитель 2, чтобы низкие частоты прямого преобразования выглядели как усреднение
+  f.low_pass_analysis = f.low_pass_synthesis;
+  for (auto & v : f.low_pass_analysis)
+    v /= 2;
+  f.hi_pass_analysis = f.hi_pass_synthesis;
+  for (auto & v : f.hi_pass_analysis)
+    v /= 2;
+  return f;
+}
+
+// для биортогонального базиса
+inline wavelet_filters biorthogonal_filters(const std::vector<float> & low_pass_analysis, const std::vector<float> & low_pass_synthesis)
+{
+  wavelet_filters f;
+  f.low_pass_analysis = low_pass_analysis;
+  f.low_pass_synthesis = low_pass_synthesis;
+
+  f.hi_pass_analysis.reserve(low_pass_synthesis.size() + 2);
+  f.hi_pass_analysis.push_back(0);
+  f.hi_pass_analysis.push_back(0);
+  f.hi_pass_analysis.insert(f.hi_pass_analysis.end(), low_pass_synthesis.begin(), low_pass_synthesis.end());
+  negate_every_second(f.hi_pass_analysis, 0);
+
+  f.hi_pass_synthesis.reserve(low_pass_analysis.size() + 2);
+  f.hi_pass_synthesis.push_back(0);
+  f.hi_pass_synthesis.push_back(0);
+  f.hi_pass_synthesis.insert(f.hi_pass_synthesis.end(), low_pass_analysis.begin(), low_pass_analysis.end());
+  negate_every_second(f.hi_pass_synthesis, 1);
+  return f;
+}
+
+// имена базисов, известных named_wavelet_filters
+const char * const WAVELET_NAMES[] = { "D2", "D4", "D6", "D8", "CDF5", "CDF9" };
+
+// фильтры базиса по имени
+inline wavelet_filters named_wavelet_filters(const std::string & name)
+{
+  // https://en.wikipedia.org/wiki/Daubechies_wavelet
+  if (name == "D2") //Haar
+    return orthogonal_filters({ 1, 1 });
+  if (name == "D4")
+    return orthogonal_filters({ 0.6830127f, 1.1830127f, 0.3169873f, -0.1830127f });
+  if (name == "D6")
+    return orthogonal_filters({ 0.47046721f, 1.14111692f, 0.650365f, -0.19093442f, -0.12083221f, 0.0498175f });
+  if (name == "D8")
+    return orthogonal_filters({ 0.32580343f, 1.01094572f, 0.89220014f, -0.03957503f, -0.26450717f, 0.0436163f, 0.0465036f, -0.01498699f });
+
+  // https://en.wikipedia.org/wiki/Cohen-Daubechies-Feauveau_wavelet
+  if (name == "CDF5") //LeGall 5/3
+    return biorthogonal_filters(
+      { -0.125f, 0.25f, 0.75f, 0.25f, -0.125f },
+      { 0.5f, 1.0f, 0.5f });
+  if (name == "CDF9") //9/7-CDF-wavelet
+    return biorthogonal_filters(
+      { 0.026748757411f, -0.016864118443f, -0.078223266529f, 0.266864118443f, 0.602949018236f, 0.266864118443f, -0.078223266529f, -0.016864118443f, 0.026748757411f },
+      { -0.091271763114f, -0.057543526229f, 0.591271763114f, 1.11508705f, 0.591271763114f, -0.057543526229f, -0.091271763114f });
+
+  throw std::runtime_error("unknown wavelet " + name);
+}
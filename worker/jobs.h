@@ -0,0 +1,462 @@
+﻿#pragma once
+
+// задания для постоянно работающего процесса-обработчика (worker.cpp) и его состояние между заданиями:
+// кэш загруженных изображений и профилей гистограмм, рабочие изображения, которые переиспользуются
+// от задания к заданию, и статистика времени выполнения;
+// задание - одна строка "вид ключ=значение ...", например
+//   copy_hist in=a.jpg reference=b.jpg out=a-res.png
+//   wavelet in=lena.png out=transformed.png basis=CDF9 levels=3 restored=restored.png
+//   segm in=42049.jpg out=42049-segm.png levels=2
+//   poisson fore=fore.png back=back.png out=import.png mode=import iters=300
+// служебные задания: stats - процентили времени выполнения, profile [reset=1] - время по этапам алгоритмов
+// ответ - одна строка JSON
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <deque>
+#include <list>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+
+#include "../gil_utils/float_views_io.h"
+#include "../copy_hist/copy_hist.h"
+#include "../wavelet/wavelet.h"
+#include "../segm/segmentation.h"
+#include "../poisson/poisson.h"
+
+// сколько последних заданий каждого вида учитывается в процентилях
+const size_t LATENCY_WINDOW = 10000;
+
+// наибольшее число уровней вейвлет-преобразования в задании: стороны изображения делятся на 2^levels
+const int MAX_WAVELET_LEVELS = 16;
+
+// направления переноса гистограммы, как в copy_hist.cpp
+const float COPY_HIST_DIRS[3][3] = { { 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 } };
+
+struct job_request
+{
+  std::string kind;
+  std::map<std::string, std::string> args;
+
+  const std::string & get(const std::string & key) const
+  {
+    auto it = args.find(key);
+    if (it == args.end())
+      throw std::runtime_error(kind + ": missing " + key + "=");
+    return it->second;
+  }
+
+  std::string get(const std::string & key, const std::string & def) const
+  {
+    auto it = args.find(key);
+    return it == args.end() ? def : it->second;
+  }
+
+  int get_int(const std::string & key, int def) const
+  {
+    auto it = args.find(key);
+    return it == args.end() ? def : std::stoi(it->second);
+  }
+};
+
+inline job_request parse_job(const std::string & line)
+{
+  job_request job;
+  std::istringstream ss(line);
+  ss >> job.kind;
+  std::string item;
+  while (ss >> item)
+  {
+    auto eq = item.find('=');
+    if (eq == std::string::npos || eq == 0)
+      throw std::runtime_error("expected key=value instead of " + item);
+    job.args[item.substr(0, eq)] = item.substr(eq + 1);
+  }
+  return job;
+}
+
+inline std::string json_escape(const std::string & s)
+{
+  std::string res;
+  for (char c : s)
+  {
+    if (c == '"' || c == '\\')
+      res += '\\';
+    if (c == '\n' || c == '\r' || c == '\t')
+      c = ' ';
+    res += c;
+  }
+  return res;
+}
+
+inline bool has_extension(const std::string & path, const char * ext)
+{
+  std::string e(ext);
+  if (path.size() < e.size())
+    return false;
+  return std::equal(e.begin(), e.end(), path.end() - e.size(), [](char a, char b) { return a == std::tolower(b); });
+}
+
+// ввод-вывод по расширению файла: .png или .jpg/.jpeg
+template <typename Image>
+void read_image(const std::string & path, Image & img)
+{
+  if (has_extension(path, ".png"))
+    png_read_and_convert_image(path, img);
+  else if (has_extension(path, ".jpg") || has_extension(path, ".jpeg"))
+    jpeg_read_and_convert_image(path, img);
+  else
+    throw std::runtime_error("unsupported image format " + path);
+}
+
+template <typename View>
+void write_float_view(const std::string & path, const View & v)
+{
+  if (has_extension(path, ".png"))
+    png_write_float_view(path.c_str(), v);
+  else if (has_extension(path, ".jpg") || has_extension(path, ".jpeg"))
+    jpeg_write_view(path, color_converted_view<rgb8_pixel_t>(v));
+  else
+    throw std::runtime_error("unsupported image format " + path);
+}
+
+template <typename View>
+void write_gray_view(const std::string & path, const View & v)
+{
+  if (has_extension(path, ".png"))
+    png_write_view(path, v);
+  else if (has_extension(path, ".jpg") || has_extension(path, ".jpeg"))
+    jpeg_write_view(path, v);
+  else
+    throw std::runtime_error("unsupported image format " + path);
+}
+
+// размер и время изменения файла: запись кэша годна, пока они не поменялись
+struct file_stamp
+{
+  long long size = -1, mtime = -1;
+  bool operator ==(const file_stamp & o) const { return size == o.size && mtime == o.mtime; }
+};
+
+inline file_stamp get_file_stamp(const std::string & path)
+{
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0)
+    throw std::runtime_error("cannot open " + path);
+  file_stamp s;
+  s.size = st.st_size;
+  s.mtime = st.st_mtime;
+  return s;
+}
+
+// кэш загруженных из файлов объектов с вытеснением давно не использованных при превышении объема
+template <typename T>
+class file_cache
+{
+public:
+  explicit file_cache(size_t capacity_bytes) : capacity_(capacity_bytes) { }
+
+  // load(path, value) загружает объект, bytes(value) - его объем в памяти
+  template <typename Load, typename Bytes>
+  std::shared_ptr<const T> get(const std::string & path, Load load, Bytes bytes)
+  {
+    auto stamp = get_file_stamp(path);
+    auto it = index_.find(path);
+    if (it != index_.end())
+    {
+      if (it->second->stamp == stamp)
+      {
+        ++hits_;
+        entries_.splice(entries_.begin(), entries_, it->second);
+        return it->second->value;
+      }
+      erase(it);
+    }
+    ++misses_;
+    auto value = std::make_shared<T>();
+    load(path, *value);
+    entries_.push_front({ path, stamp, value, bytes(*value) });
+    index_[path] = entries_.begin();
+    used_ += entries_.front().bytes;
+    // последнюю загруженную запись не вытесняем, даже если она одна больше всего кэша
+    while (used_ > capacity_ && entries_.size() > 1)
+      erase(index_.find(entries_.back().path));
+    return value;
+  }
+
+  size_t hits() const { return hits_; }
+  size_t misses() const { return misses_; }
+  size_t used_bytes() const { return used_; }
+
+private:
+  struct entry
+  {
+    std::string path;
+    file_stamp stamp;
+    std::shared_ptr<const T> value;
+    size_t bytes;
+  };
+  using entries_t = std::list<entry>;
+
+  void erase(typename std::map<std::string, typename entries_t::iterator>::iterator it)
+  {
+    used_ -= it->second->bytes;
+    entries_.erase(it->second);
+    index_.erase(it);
+  }
+
+  size_t capacity_, used_ = 0, hits_ = 0, misses_ = 0;
+  entries_t entries_;
+  std::map<std::string, typename entries_t::iterator> index_;
+};
+
+template <typename Image>
+size_t image_bytes(const Image & img)
+{
+  return size_t(img.width()) * img.height() * sizeof(typename Image::value_type);
+}
+
+// эталонное изображение для переноса гистограммы вместе с его профилями по направлениям COPY_HIST_DIRS
+struct hist_reference
+{
+  rgb32f_image_t image;
+  std::vector<pix_values> profiles;
+};
+
+// времена выполнения последних LATENCY_WINDOW заданий каждого вида
+class latency_stats
+{
+public:
+  void add(const std::string & kind, double seconds)
+  {
+    auto & s = samples_[kind];
+    s.push_back(seconds);
+    if (s.size() > LATENCY_WINDOW)
+      s.pop_front();
+    ++counts_[kind];
+  }
+
+  // {"вид": {"count": всего, "p50": мс, "p90": мс, "p99": мс, "max": мс}, ...}
+  std::string to_json() const
+  {
+    std::ostringstream out;
+    out << "{";
+    bool first = true;
+    for (const auto & k : samples_)
+    {
+      std::vector<double> v(k.second.begin(), k.second.end());
+      std::sort(v.begin(), v.end());
+      // процентиль по ближайшему рангу
+      auto pct = [&](double p) { return 1000 * v[std::max<size_t>(1, size_t(std::ceil(p * v.size()))) - 1]; };
+      out << (first ? "" : ", ") << "\"" << k.first << "\": {\"count\": " << counts_.at(k.first)
+        << ", \"p50\": " << pct(0.5) << ", \"p90\": " << pct(0.9) << ", \"p99\": " << pct(0.99)
+        << ", \"max\": " << 1000 * v.back() << "}";
+      first = false;
+    }
+    out << "}";
+    return out.str();
+  }
+
+private:
+  std::map<std::string, std::deque<double>> samples_;
+  std::map<std::string, size_t> counts_;
+};
+
+// состояние обработчика между заданиями
+class job_context
+{
+public:
+  explicit job_context(size_t cache_bytes)
+    : color_images_(cache_bytes / 2), gray_images_(cache_bytes / 4), references_(cache_bytes / 4)
+  {
+  }
+
+  // выполняет одно задание и возвращает строку ответа
+  std::string run(const std::string & line)
+  {
+    auto start = std::chrono::steady_clock::now();
+    std::string kind;
+    try
+    {
+      auto job = parse_job(line);
+      kind = job.kind;
+      if (kind == "stats")
+        return "{\"ok\": true, \"latency_ms\": " + stats_.to_json() + ", \"cache\": " + cache_json() + "}";
+      if (kind == "profile")
+      {
+        // разбивка по этапам алгоритмов (только в сборке с MIPTCG_PROFILE), reset=1 обнуляет ее после выдачи
+        auto res = "{\"ok\": true, \"profile\": " + profile_report_json() + "}";
+        if (job.get("reset", "0") == "1")
+          profile_reset();
+        return res;
+      }
+      if (kind == "copy_hist")
+        copy_hist(job);
+      else if (kind == "wavelet")
+        wavelet(job);
+      else if (kind == "segm")
+        segm(job);
+      else if (kind == "poisson")
+        poisson(job);
+      else
+        throw std::runtime_error("unknown job " + kind);
+    }
+    catch (const std::exception & e)
+    {
+      return "{\"ok\": false, \"job\": \"" + json_escape(kind) + "\", \"error\": \"" + json_escape(e.what()) + "\"}";
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    stats_.add(kind, seconds);
+    std::ostringstream out;
+    out << "{\"ok\": true, \"job\": \"" << kind << "\", \"ms\": " << 1000 * seconds << "}";
+    return out.str();
+  }
+
+  const latency_stats & stats() const { return stats_; }
+
+private:
+  std::shared_ptr<const rgb32f_image_t> color_image(const std::string & path)
+  {
+    return color_images_.get(path,
+      [](const std::string & p, rgb32f_image_t & img) { read_image(p, img); }, image_bytes<rgb32f_image_t>);
+  }
+
+  std::shared_ptr<const gray8_image_t> gray_image(const std::string & path)
+  {
+    return gray_images_.get(path,
+      [](const std::string & p, gray8_image_t & img) { read_image(p, img); }, image_bytes<gray8_image_t>);
+  }
+
+  std::string cache_json() const
+  {
+    std::ostringstream out;
+    out << "{\"hits\": " << color_images_.hits() + gray_images_.hits() + references_.hits()
+      << ", \"misses\": " << color_images_.misses() + gray_images_.misses() + references_.misses()
+      << ", \"bytes\": " << color_images_.used_bytes() + gray_images_.used_bytes() + references_.used_bytes() << "}";
+    return out.str();
+  }
+
+  // in - изменяемое изображение, reference - эталон гистограммы (загружается и сортируется один раз)
+  void copy_hist(const job_request & job)
+  {
+    auto ref = references_.get(job.get("reference"),
+      [](const std::string & p, hist_reference & r)
+      {
+        read_image(p, r.image);
+        for (const auto & d : COPY_HIST_DIRS)
+          r.profiles.push_back(get_sorted_values(get_pix_values_in_color_direction(const_view(r.image), color_dir(d[0], d[1], d[2]))));
+      },
+      [](const hist_reference & r) { return image_bytes(r.image) + r.profiles.size() * r.profiles[0].size() * sizeof(float); });
+
+    auto in = color_image(job.get("in"));
+    img_.recreate(in->dimensions());
+    copy_pixels(const_view(*in), view(img_));
+    for (size_t i = 0; i < ref->profiles.size(); ++i)
+    {
+      const auto & d = COPY_HIST_DIRS[i];
+      copy_hist_in_dir_sorted(view(img_), ref->profiles[i], color_dir(d[0], d[1], d[2]));
+    }
+    write_float_view(job.get("out"), const_view(img_));
+  }
+
+  // прямое преобразование в out и, если задан restored, обратное
+  void wavelet(const job_request & job)
+  {
+    auto in = color_image(job.get("in"));
+    auto f = named_wavelet_filters(job.get("basis", "CDF9"));
+    int levels = job.get_int("levels", 3);
+    if (levels < 1 || levels > MAX_WAVELET_LEVELS)
+      throw std::runtime_error("wavelet: levels shall be from 1 to " + std::to_string(MAX_WAVELET_LEVELS));
+    if (in->width() % (1 << levels) != 0 || in->height() % (1 << levels) != 0)
+      throw std::runtime_error("wavelet: image dimensions shall be divisible by 2^levels");
+
+    img_.recreate(in->dimensions());
+    wavelet_transform(levels, const_view(*in), view(img_), f.low_pass_analysis, f.hi_pass_analysis, wavelet_ws_);
+    write_float_view(job.get("out"), const_view(img_));
+
+    auto restored = job.get("restored", "");
+    if (!restored.empty())
+    {
+      result_.recreate(in->dimensions());
+      inverse_transform(levels, const_view(img_), view(result_), f.low_pass_synthesis, f.hi_pass_synthesis, wavelet_ws_);
+      write_float_view(restored, const_view(result_));
+    }
+  }
+
+  // как main() в segmentation.cpp, записывается только итоговая маска;
+  // levels > 0 - второй этап (find_dss) по пирамиде из стольких уровней с уточнением в узкой полосе у границы;
+  // первый этап всегда считается find_ds: он сходится за один-два прохода, и пирамида его только замедляет
+  void segm(const job_request & job)
+  {
+    auto pic = gray_image(job.get("in"));
+    auto dim = pic->dimensions();
+    int levels = job.get_int("levels", 0);
+    ds_.recreate(dim);
+    find_ds(const_view(*pic), view(ds_));
+
+    auto Me = function_view(const_view(ds_), discretizor(-TETHA_E, 1, 0));
+    auto notMd = function_view(const_view(ds_), discretizor(TETHA_D, 0, 1));
+    dss_.recreate(dim);
+    if (levels > 0)
+      find_dss_multires(const_view(*pic), Me, notMd, view(dss_), levels);
+    else
+      find_dss(const_view(*pic), Me, notMd, view(dss_));
+
+    auto segm = function_view(const_view(dss_), discretizor(0, 1, 0));
+    write_gray_view(job.get("out"), color_converted_view<gray8_pixel_t>(segm));
+  }
+
+  // mode: clone, laplace, import, mixed или mvc, как в poisson.cpp
+  void poisson(const job_request & job)
+  {
+    auto fore = color_image(job.get("fore"));
+    auto back = color_image(job.get("back"));
+    if (fore->dimensions() != back->dimensions())
+      throw std::runtime_error("poisson: fore and back shall have the same dimensions");
+    auto mode = job.get("mode", "import");
+    int iters = job.get_int("iters", 300);
+
+    mask_.recreate(fore->dimensions());
+    copy_pixels(color_converted_view<gray8_pixel_t>(const_view(*fore),
+      [](const auto & src, auto & dst) { dst = (get_color(src, red_t()) != 0 || get_color(src, green_t()) != 0 || get_color(src, blue_t()) != 0) ? 1 : 0; }), view(mask_));
+    erode(view(mask_));
+
+    result_.recreate(back->dimensions());
+    copy_pixels(const_view(*back), view(result_));
+    if (mode == "clone")
+      clone(const_view(mask_), const_view(*fore), view(result_));
+    else if (mode == "mvc")
+      mvc_membrane(const_view(mask_)).clone(const_view(*fore), const_view(*back), view(result_));
+    else
+    {
+      img_.recreate(fore->dimensions());
+      if (mode == "laplace")
+        fill_pixels(view(img_), rgb32f_pixel_t(0, 0, 0));
+      else if (mode == "import")
+        get_laplacian(const_view(mask_), const_view(*fore), view(img_));
+      else if (mode == "mixed")
+        get_absmax_laplacian(const_view(mask_), const_view(*fore), const_view(*back), view(img_));
+      else
+        throw std::runtime_error("poisson: unknown mode " + mode);
+      solve_poisson(iters, const_view(mask_), view(result_), const_view(img_));
+    }
+    write_float_view(job.get("out"), const_view(result_));
+  }
+
+  file_cache<rgb32f_image_t> color_images_;
+  file_cache<gray8_image_t> gray_images_;
+  file_cache<hist_reference> references_;
+  latency_stats stats_;
+
+  // рабочие изображения: recreate не перевыделяет память, пока размер не растет
+  rgb32f_image_t img_, result_;
+  gray8_image_t mask_;
+  gray32fu_image_t ds_, dss_;
+  wavelet_workspace<> wavelet_ws_;
+};
@@ -0,0 +1,204 @@
+﻿// постоянно работающий обработчик заданий: принимает задания (по одному в строке, см. jobs.h)
+// со стандартного ввода или через локальный сокет Unix и отвечает на каждое одной строкой JSON;
+// между заданиями сохраняются потоки OpenMP, рабочие изображения и кэш входных изображений,
+// так что повторные задания не платят за запуск процесса, выделение памяти и декодирование эталонов
+//
+// использование:
+//   worker [--socket /tmp/miptcg.sock] [--cache-mb 1024] [--threads N]
+// служебные команды: stats - процентили времени выполнения по видам заданий,
+// profile [reset=1] - время и аппаратные счетчики по этапам алгоритмов (сборка с MIPTCG_PROFILE), quit - завершение
+
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "../gil_utils/gil_compat.h"
+using namespace boost::gil;
+
+#include "jobs.h"
+
+struct worker_options
+{
+  std::string socket;
+  size_t cache_mb = 1024;
+  int threads = 0;
+};
+
+worker_options parse_options(int argc, char * argv[])
+{
+  worker_options opt;
+  for (int i = 1; i < argc; ++i)
+  {
+    std::string arg = argv[i];
+    if (i + 1 >= argc)
+      throw std::runtime_error("missing value for " + arg);
+    std::string value = argv[++i];
+    if (arg == "--socket")
+      opt.socket = value;
+    else if (arg == "--cache-mb")
+      opt.cache_mb = std::stoul(value);
+    else if (arg == "--threads")
+      opt.threads = std::stoi(value);
+    else
+      throw std::runtime_error("unknown option " + arg);
+  }
+  return opt;
+}
+
+// запускает потоки OpenMP заранее, чтобы первое задание не платило за их создание
+void warm_up_threads(int threads)
+{
+#ifdef _OPENMP
+  if (threads > 0)
+    omp_set_num_threads(threads);
+  omp_set_dynamic(0);
+  int started = 0;
+  #pragma omp parallel reduction(+:started)
+  started += 1;
+  std::cerr << "worker: " << started << " threads" << std::endl;
+#else
+  (void)threads;
+#endif
+}
+
+// обрабатывает одну строку; возвращает false по команде quit
+bool serve_line(job_context & ctx, const std::string & line, std::string & reply)
+{
+  auto first = line.find_first_not_of(" \t\r");
+  if (first == std::string::npos)
+    return true;
+  auto last = line.find_first_of(" \t\r", first);
+  if (line.compare(first, last == std::string::npos ? std::string::npos : last - first, "quit") == 0)
+  {
+    reply = "{\"ok\": true, \"job\": \"quit\"}\n";
+    return false;
+  }
+  reply = ctx.run(line.substr(first)) + "\n";
+  return true;
+}
+
+void serve_stdin(job_context & ctx)
+{
+  std::string line, reply;
+  while (std::getline(std::cin, line))
+  {
+    reply.clear();
+    bool go_on = serve_line(ctx, line, reply);
+    std::cout << reply << std::flush;
+    if (!go_on)
+      break;
+  }
+}
+
+#ifndef _WIN32
+// соединения обслуживаются по очереди: задания все равно занимают все ядра и общие рабочие изображения
+void serve_socket(job_context & ctx, const std::string & path)
+{
+  sockaddr_un addr = {};
+  addr.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(addr.sun_path))
+    throw std::runtime_error("socket path is too long");
+  int server = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (server < 0)
+    throw std::runtime_error("cannot create socket");
+  path.copy(addr.sun_path, path.size());
+  unlink(path.c_str());
+  if (bind(server, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 || listen(server, 16) != 0)
+  {
+    close(server);
+    throw std::runtime_error("cannot listen on " + path);
+  }
+  std::cerr << "worker: listening on " << path << std::endl;
+
+  bool go_on = true;
+  while (go_on)
+  {
+    int conn = accept(server, nullptr, nullptr);
+    if (conn < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      // остальные ошибки (например, EMFILE) повторялись бы бесконечно
+      std::string error = std::strerror(errno);
+      close(server);
+      unlink(path.c_str());
+      throw std::runtime_error("cannot accept connection on " + path + ": " + error);
+    }
+    std::string pending, reply;
+    char buf[4096];
+    while (go_on)
+    {
+      // прерванное сигналом чтение повторяется, как и accept, а не обрывает задание клиента
+      ssize_t n = read(conn, buf, sizeof(buf));
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0)
+        break;
+      pending.append(buf, size_t(n));
+      size_t eol;
+      while (go_on && (eol = pending.find('\n')) != std::string::npos)
+      {
+        reply.clear();
+        go_on = serve_line(ctx, pending.substr(0, eol), reply);
+        pending.erase(0, eol + 1);
+        for (size_t sent = 0; sent < reply.size(); )
+        {
+          auto w = write(conn, reply.data() + sent, reply.size() - sent);
+          if (w < 0 && errno == EINTR)
+            continue;
+          if (w <= 0)
+            break;
+          sent += size_t(w);
+        }
+      }
+    }
+    close(conn);
+  }
+  close(server);
+  unlink(path.c_str());
+}
+#endif
+
+int main(int argc, char * argv[])
+{
+  try
+  {
+    auto opt = parse_options(argc, argv);
+    profile_start();
+#ifndef _WIN32
+    // клиент, закрывший соединение до ответа, не должен завершать обработчик вместе с его кэшами:
+    // вместо сигнала write вернет ошибку EPIPE
+    signal(SIGPIPE, SIG_IGN);
+#endif
+    warm_up_threads(opt.threads);
+    job_context ctx(opt.cache_mb << 20);
+    if (opt.socket.empty())
+      serve_stdin(ctx);
+    else
+    {
+#ifdef _WIN32
+      throw std::runtime_error("unix sockets are not supported on this platform, use standard input");
+#else
+      serve_socket(ctx, opt.socket);
+#endif
+    }
+    std::cerr << "worker: latency_ms " << ctx.stats().to_json() << std::endl;
+  }
+  catch (const std::exception & e)
+  {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}